@@ -0,0 +1,430 @@
+// Benchmarks for the expression engine: the stages of compile(), evaluation on every backend, the call
+// pattern of the TerrainShaper hooks with a stand-in for the vanilla functions, and how that scales over
+// threads. Results go to stdout as JSON, or CSV with --csv, so runs of different versions can be diffed.
+//
+// Usage: expr_bench [--csv] [--quick] [--threads N]
+
+#include "expr/CompileTimes.hpp"
+#include "expr/Expr.hpp"
+#include "expr/Jit.hpp"
+#include "expr/Kernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+// Counts operator new calls on the current thread.
+thread_local std::uint64_t allocations = 0;
+} // namespace
+
+void* operator new(std::size_t size) {
+    allocations++;
+    if (auto p = std::malloc(size ? size : 1)) return p;
+    std::abort();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+struct Formula {
+    const char* name;
+    const char* code;
+};
+
+// Shapes of formulas seen in real configs, from trivial to tuple-heavy.
+constexpr Formula corpus[] = {
+    {"identity",      "ori;"                                                           },
+    {"scale",         "ori*1.25;"                                                      },
+    {"shift",         "ori+continentalness*0.1-0.05;"                                  },
+    {"flatten",       "ori*(1-max(con(continentalness,0))*0.5);"                       },
+    {"ridge",         "max(con(ori,weirdness*0.3,0-erosion*0.2))*1.1;"                 },
+    {"blend",         "(ori*3+continentalness+erosion)/(4+weirdness*weirdness);"       },
+    {"weighted",      "sum(con(ori,erosion,weirdness)*tuple(3,0.3333));"               },
+    {"median",        "of(1,sort(con(ori,erosion,weirdness)));"                        },
+    {"stack",         "push(ori*2);push(continentalness);pop()+pop()*0.5;"             },
+    {"spline",        "spline(continentalness,-1.1,0.044,0,-0.19,-0.12,0,0.3,0.2,1)*ori;"},
+    {"long",
+     "(ori*1.1+0.1)*(ori*0.9-0.1)+(continentalness*erosion-weirdness)*(ori+1)/(2+erosion*erosion)"
+     "+max(con(ori,continentalness,erosion,weirdness))-min(con(ori,continentalness,erosion,weirdness));"},
+};
+
+struct Config {
+    const char* name;
+    const char* factor;
+    const char* jaggedness;
+    const char* offset;
+};
+
+constexpr Config configs[] = {
+    {"vanilla", "ori;",      "ori;",                           "ori;"                                    },
+    {"typical", "ori*1.25;", "max(con(ori,weirdness*0.3))*1.1;", "ori+continentalness*0.1-0.05;"            },
+    {"heavy",   "(ori*3+continentalness+erosion)/(4+weirdness*weirdness);",
+                "sum(con(ori,erosion,weirdness)*tuple(3,0.3333));",
+                "ori*(1-max(con(continentalness,0))*0.5);"                                                  },
+    {"stack",   "push(ori*2);push(continentalness);pop()+pop()*0.5;", "of(1,sort(con(ori,erosion,weirdness)));",
+                "ori;"                                                                                    },
+};
+
+// A Catmull-Rom spline through fixed points, standing in for the vanilla terrain splines.
+float spline(float x, const std::array<float, 8>& points) {
+    auto t = std::clamp((x + 1.2f) / 2.4f * 7.0f, 0.0f, 6.999f);
+    auto i = static_cast<std::size_t>(t);
+    auto f = t - static_cast<float>(i);
+    auto p0 = points[i == 0 ? 0 : i - 1], p1 = points[i], p2 = points[i + 1], p3 = points[i + 2 > 7 ? 7 : i + 2];
+    return p1 + 0.5f * f * (p2 - p0 + f * (2 * p0 - 5 * p1 + 4 * p2 - p3 + f * (3 * (p1 - p2) + p3 - p0)));
+}
+constexpr std::array<float, 8> factor_points{3.9f, 4.1f, 5.2f, 6.3f, 5.8f, 4.4f, 3.1f, 2.9f};
+constexpr std::array<float, 8> jaggedness_points{0.0f, 0.0f, 0.1f, 0.4f, 0.7f, 0.3f, 0.0f, 0.0f};
+constexpr std::array<float, 8> offset_points{-0.4f, -0.2f, -0.1f, 0.0f, 0.1f, 0.25f, 0.4f, 0.6f};
+
+float vanilla(const std::array<float, 8>& points, float c, float e, float w) {
+    return spline(c, points) + 0.5f * spline(e, points) - 0.25f * spline(w, points);
+}
+
+struct Samples {
+    std::vector<float> ori, continentalness, erosion, weirdness;
+};
+Samples make_samples(std::size_t n) {
+    Samples                               res;
+    std::mt19937                          rng(42);
+    std::uniform_real_distribution<float> c(-1.2f, 1.2f), ew(-1.0f, 1.0f);
+    for (std::size_t i = 0; i < n; i++) {
+        res.continentalness.push_back(c(rng));
+        res.erosion.push_back(ew(rng));
+        res.weirdness.push_back(ew(rng));
+        res.ori.push_back(vanilla(factor_points, res.continentalness[i], res.erosion[i], res.weirdness[i]));
+    }
+    return res;
+}
+
+struct Record {
+    std::string bench;
+    std::string name;
+    std::string variant;
+    unsigned    threads = 1;
+    double      ns      = 0; // wall time per operation
+    double      allocs  = 0; // operator new calls per operation
+};
+
+struct Options {
+    bool     csv     = false;
+    bool     quick   = false;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+double seconds_since(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// Keeps results alive so the evaluation can't be optimized away.
+volatile float sink;
+
+void bench_compile(const Options& options, std::vector<Record>& records) {
+    auto rounds = options.quick ? 200 : 2000;
+    for (auto& formula : corpus) {
+        expr::CompileTimes sum;
+        auto               before = allocations;
+        auto               begin  = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            auto program = expr::compile(formula.code);
+            if (!program) std::abort();
+            auto& times     = expr::last_compile_times();
+            sum.parse      += times.parse;
+            sum.lower      += times.lower;
+            sum.specialize += times.specialize;
+        }
+        auto total  = seconds_since(begin) * 1e9 / rounds;
+        auto allocs = static_cast<double>(allocations - before) / rounds;
+        records.push_back({"compile", formula.name, "parse", 1, sum.parse / rounds, 0});
+        records.push_back({"compile", formula.name, "lower", 1, sum.lower / rounds, 0});
+        records.push_back({"compile", formula.name, "specialize", 1, sum.specialize / rounds, 0});
+        records.push_back({"compile", formula.name, "total", 1, total, allocs});
+    }
+}
+
+void bench_eval(const Options& options, const Samples& samples, std::vector<Record>& records) {
+    std::size_t calls = options.quick ? 50000 : 500000;
+    auto        n     = samples.ori.size();
+    for (auto& formula : corpus) {
+        auto program = *expr::compile(formula.code);
+        for (auto [variant, backend] : {
+                 std::pair{"tree", expr::Backend::Tree},
+                 std::pair{"bytecode", expr::Backend::Bytecode},
+                 std::pair{"jit", expr::Backend::Jit},
+             }) {
+            program.setBackend(backend);
+            if (backend == expr::Backend::Jit && !program.isNative()) continue;
+            float acc = 0;
+            for (std::size_t i = 0; i < 1000; i++) { // warm up the thread's EvalContext
+                acc += program.evalFirst({samples.ori[i % n], 0.1f, 0.2f, 0.3f}, 0);
+            }
+            auto before = allocations;
+            auto begin  = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < calls; i++) {
+                auto k  = i % n;
+                acc    += program.evalFirst(
+                    {samples.ori[k], samples.continentalness[k], samples.erosion[k], samples.weirdness[k]},
+                    samples.ori[k]
+                );
+            }
+            auto seconds = seconds_since(begin);
+            sink         = acc;
+            records.push_back(
+                {"eval",
+                 formula.name,
+                 variant,
+                 1,
+                 seconds * 1e9 / static_cast<double>(calls),
+                 static_cast<double>(allocations - before) / static_cast<double>(calls)}
+            );
+        }
+
+        program.setBackend(expr::Backend::Bytecode);
+        {
+            // What a sample taken by the plugin's profiler costs.
+            expr::Profile profile;
+            auto&         context = expr::EvalContext::local();
+            float         acc     = 0;
+            auto          before  = allocations;
+            auto          begin   = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < calls; i++) {
+                auto k  = i % n;
+                acc    += program.evalFirst(
+                    {samples.ori[k], samples.continentalness[k], samples.erosion[k], samples.weirdness[k]},
+                    samples.ori[k],
+                    profile,
+                    context
+                );
+            }
+            auto seconds = seconds_since(begin);
+            sink         = acc;
+            records.push_back(
+                {"eval",
+                 formula.name,
+                 "profiled",
+                 1,
+                 seconds * 1e9 / static_cast<double>(calls),
+                 static_cast<double>(allocations - before) / static_cast<double>(calls)}
+            );
+        }
+
+        std::vector<float> out(n);
+        auto               rounds = std::max<std::size_t>(1, calls / n);
+        program.evalBatch(samples.ori, samples.continentalness, samples.erosion, samples.weirdness, out);
+        auto before = allocations;
+        auto begin  = std::chrono::steady_clock::now();
+        for (std::size_t r = 0; r < rounds; r++) {
+            program.evalBatch(samples.ori, samples.continentalness, samples.erosion, samples.weirdness, out);
+        }
+        auto seconds = seconds_since(begin);
+        sink         = out[0];
+        auto ops     = static_cast<double>(rounds * n);
+        records.push_back(
+            {"eval", formula.name, "batch", 1, seconds * 1e9 / ops, static_cast<double>(allocations - before) / ops}
+        );
+    }
+}
+
+// The three formulas of a config as Hooks.cpp uses them.
+struct Hooks {
+    std::array<expr::Program, 3>       programs;
+    std::optional<expr::FusedProgram> fused;
+    std::array<bool, 3>               vanilla{}; // whether each program needs its vanilla value
+
+    explicit Hooks(const Config& config, bool fuse)
+    : programs{*expr::compile(config.factor), *expr::compile(config.jaggedness), *expr::compile(config.offset)} {
+        if (fuse) fused = expr::fuse(programs);
+        for (std::size_t i = 0; i < 3; i++) {
+            auto& inputs = programs[i].inputs();
+            vanilla[i]   = inputs.slots[static_cast<std::size_t>(expr::Slot::Ori)] || inputs.fallback;
+        }
+    }
+};
+
+// Mirrors the per-thread memo in plugin/FusedMemo.hpp.
+struct Memo {
+    std::array<std::uint32_t, 3> key{0xffffffff, 0xffffffff, 0xffffffff};
+    std::array<float, 3>         values{};
+};
+
+float hook(const Hooks& hooks, Memo& memo, std::size_t output, float c, float e, float w) {
+    static constexpr const std::array<float, 8>* points[] = {&factor_points, &jaggedness_points, &offset_points};
+    if (hooks.programs[output].isIdentity()) return vanilla(*points[output], c, e, w);
+    if (hooks.fused) {
+        std::array key{
+            std::bit_cast<std::uint32_t>(c),
+            std::bit_cast<std::uint32_t>(e),
+            std::bit_cast<std::uint32_t>(w),
+        };
+        if (memo.key != key) {
+            std::array<float, 3> ori{};
+            for (std::size_t i = 0; i < 3; i++) {
+                if (hooks.vanilla[i] && !hooks.programs[i].isIdentity()) ori[i] = vanilla(*points[i], c, e, w);
+            }
+            hooks.fused->evalFirst(ori, c, e, w, memo.values);
+            memo.key = key;
+        }
+        return memo.values[output];
+    }
+    auto ori = hooks.vanilla[output] ? vanilla(*points[output], c, e, w) : 0.0f;
+    return hooks.programs[output].evalFirst({ori, c, e, w}, ori);
+}
+
+// Runs `points` worldgen samples on each of `threads` threads; returns the wall time.
+double
+run_hooks(const Hooks& hooks, const Samples& samples, std::size_t points, unsigned threads, std::uint64_t* allocs) {
+    std::vector<std::thread>   workers;
+    std::vector<std::uint64_t> counts(threads);
+    auto                       begin = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            Memo  memo;
+            float acc    = 0;
+            auto  n      = samples.ori.size();
+            auto  before = allocations;
+            for (std::size_t i = 0; i < points; i++) {
+                auto k = (i + t * 977) % n;
+                auto c = samples.continentalness[k], e = samples.erosion[k], w = samples.weirdness[k];
+                for (std::size_t output = 0; output < 3; output++) acc += hook(hooks, memo, output, c, e, w);
+            }
+            counts[t] = allocations - before;
+            sink      = acc;
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    auto seconds = seconds_since(begin);
+    if (allocs) {
+        *allocs = 0;
+        for (auto count : counts) *allocs += count;
+    }
+    return seconds;
+}
+
+void bench_hooks(const Options& options, const Samples& samples, std::vector<Record>& records) {
+    std::size_t points = options.quick ? 20000 : 200000;
+    for (auto& config : configs) {
+        for (auto fuse : {false, true}) {
+            Hooks hooks(config, fuse);
+            if (fuse && !hooks.fused) continue;
+            run_hooks(hooks, samples, 1000, 1, nullptr);
+            std::uint64_t allocs  = 0;
+            auto          seconds = run_hooks(hooks, samples, points, 1, &allocs);
+            auto          ops     = static_cast<double>(points);
+            records.push_back(
+                {"hooks",
+                 config.name,
+                 fuse ? "fused" : "separate",
+                 1,
+                 seconds * 1e9 / ops,
+                 static_cast<double>(allocs) / ops}
+            );
+        }
+    }
+}
+
+void bench_scaling(const Options& options, const Samples& samples, std::vector<Record>& records) {
+    std::size_t points = options.quick ? 20000 : 200000;
+    for (auto fuse : {false, true}) {
+        Hooks hooks(configs[2], fuse);
+        if (fuse && !hooks.fused) continue;
+        // Doubling up to options.threads, which is measured even when it isn't a power of two.
+        for (unsigned threads = 1;; threads = std::min(threads * 2, options.threads)) {
+            std::uint64_t allocs  = 0;
+            auto          seconds = run_hooks(hooks, samples, points, threads, &allocs);
+            auto          ops     = static_cast<double>(points) * threads;
+            records.push_back(
+                {"scaling",
+                 configs[2].name,
+                 fuse ? "fused" : "separate",
+                 threads,
+                 seconds * 1e9 / ops,
+                 static_cast<double>(allocs) / ops}
+            );
+            if (threads == options.threads) break;
+        }
+    }
+}
+
+void print_json(const std::vector<Record>& records, const Options& options) {
+    std::printf("{\n");
+    std::printf("  \"format\": 1,\n");
+    std::printf("  \"isa\": \"%s\",\n", expr::kernels::table().isa);
+    std::printf("  \"jit\": %s,\n", expr::jit::supported() ? "true" : "false");
+    std::printf("  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+    std::printf("  \"quick\": %s,\n", options.quick ? "true" : "false");
+    std::printf("  \"records\": [\n");
+    for (std::size_t i = 0; i < records.size(); i++) {
+        auto& r = records[i];
+        std::printf(
+            "    {\"bench\": \"%s\", \"name\": \"%s\", \"variant\": \"%s\", \"threads\": %u, \"ns_per_op\": %.3f, "
+            "\"allocs_per_op\": %.3f, \"ops_per_sec\": %.0f}%s\n",
+            r.bench.c_str(),
+            r.name.c_str(),
+            r.variant.c_str(),
+            r.threads,
+            r.ns,
+            r.allocs,
+            r.ns > 0 ? 1e9 / r.ns : 0.0,
+            i + 1 < records.size() ? "," : ""
+        );
+    }
+    std::printf("  ]\n}\n");
+}
+
+void print_csv(const std::vector<Record>& records) {
+    std::printf("bench,name,variant,threads,ns_per_op,allocs_per_op,ops_per_sec\n");
+    for (auto& r : records) {
+        std::printf(
+            "%s,%s,%s,%u,%.3f,%.3f,%.0f\n",
+            r.bench.c_str(),
+            r.name.c_str(),
+            r.variant.c_str(),
+            r.threads,
+            r.ns,
+            r.allocs,
+            r.ns > 0 ? 1e9 / r.ns : 0.0
+        );
+    }
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--csv") == 0) {
+            options.csv = true;
+        } else if (std::strcmp(argv[i], "--quick") == 0) {
+            options.quick = true;
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else {
+            std::fprintf(stderr, "usage: %s [--csv] [--quick] [--threads N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    auto                samples = make_samples(4096);
+    std::vector<Record> records;
+    bench_compile(options, records);
+    bench_eval(options, samples, records);
+    bench_hooks(options, samples, records);
+    bench_scaling(options, samples, records);
+    if (options.csv) {
+        print_csv(records);
+    } else {
+        print_json(records, options);
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Compiles the formulas of a config.json ahead of time. factor, jaggedness and offset are written out as
+// C++ functions, with the definitions of `functions` inlined, together with expr::codegen::generated, which
+// records them and the hash of the sources they came from. The plugin built with the result uses them while
+// its config.json holds the same formulas and functions, and the runtime engine otherwise. Formulas that
+// don't run on the float-only path (push, pop, `info`, values of unknown length) are left to the runtime
+// engine.
+//
+// Usage: climate_codegen CONFIG OUT
+
+#include "expr/Codegen.hpp"
+#include "expr/Expr.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr const char* output_names[] = {"factor", "jaggedness", "offset"};
+
+// The three formulas of a config.json, and the definitions they may call.
+struct Sources {
+    std::array<std::string, 3> formulas;
+    std::string                functions;
+};
+
+std::optional<Sources> read_sources(const std::string& path, std::string* error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        *error = "can't read " + path;
+        return std::nullopt;
+    }
+    std::string content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    auto        json = nlohmann::json::parse(content, nullptr, false, true);
+    if (json.is_discarded() || !json.is_object()) {
+        *error = path + " is not a JSON object";
+        return std::nullopt;
+    }
+    Sources res;
+    for (std::size_t i = 0; i < 3; i++) {
+        auto it         = json.find(output_names[i]);
+        res.formulas[i] = it != json.end() && it->is_string() ? it->get<std::string>() : "ori;";
+    }
+    if (auto it = json.find("functions"); it != json.end() && it->is_string()) res.functions = it->get<std::string>();
+    return res;
+}
+
+// A C++ string literal; bytes outside printable ASCII become octal escapes, which end after three digits.
+std::string quote(const std::string& text) {
+    std::string res = "\"";
+    for (auto c : text) {
+        auto byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            res += '\\';
+            res += c;
+        } else if (byte < 0x20 || byte >= 0x7f) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\%03o", byte);
+            res += escape;
+        } else {
+            res += c;
+        }
+    }
+    return res + "\"";
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: %s CONFIG OUT\n", argv[0]);
+        return 2;
+    }
+    std::string error;
+    auto        sources = read_sources(argv[1], &error);
+    if (!sources) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    // The plugin's `info` logs its argument; any formula calling it stays on the runtime engine anyway.
+    expr::FunctionTable functions{
+        {"info", [](const std::vector<std::vector<float>>& args) {
+             return args.empty() ? std::vector<float>{} : args[0];
+         }}
+    };
+    auto definitions = expr::define(sources->functions, functions, &error);
+    if (!definitions) {
+        std::fprintf(stderr, "functions \"%s\": %s\n", sources->functions.c_str(), error.c_str());
+        return 1;
+    }
+    std::string code;
+    std::string table;
+    for (std::size_t o = 0; o < 3; o++) {
+        auto& formula = sources->formulas[o];
+        auto  program = expr::compile(formula, functions, &error, *definitions);
+        if (!program) {
+            std::fprintf(stderr, "%s formula \"%s\": %s\n", output_names[o], formula.c_str(), error.c_str());
+            return 1;
+        }
+        auto function  = program->generateCpp(output_names[o]);
+        table         += o ? ", " : "";
+        if (function) {
+            code  += (o ? "\n" : "") + *function;
+            table += output_names[o];
+        } else {
+            code  += std::string(o ? "\n" : "") + "// " + output_names[o]
+                   + " uses push, pop, a user function or a value of unknown length, so it runs on the runtime "
+                     "engine.\n";
+            table += "nullptr";
+        }
+        std::printf("%s: %s\n", output_names[o], function ? "generated" : "left to the runtime engine");
+    }
+
+    auto& formulas = sources->formulas;
+    auto  hash     = expr::codegen::hash(formulas[0], formulas[1], formulas[2], sources->functions);
+    char  hex[32];
+    std::snprintf(hex, sizeof(hex), "0x%016llxull", static_cast<unsigned long long>(hash));
+
+    std::ofstream out(argv[2], std::ios::binary);
+    out << "// Generated by climate_codegen from " << argv[1] << ". Do not edit.\n"
+        << "// Compile without floating-point contraction (-ffp-contract=off) to get the interpreter's results.\n"
+        << "#include \"expr/Codegen.hpp\"\n"
+        << "#include \"expr/Spline.hpp\"\n\n"
+        << "#include <array>\n"
+        << "#include <bit>\n"
+        << "#include <cmath>\n\n"
+        << "namespace {\n"
+        << code << "} // namespace\n\n"
+        << "const expr::codegen::Formulas expr::codegen::generated{\n"
+        << "    " << hex << ",\n"
+        << "    {" << table << "},\n"
+        << "    {" << quote(formulas[0]) << ", " << quote(formulas[1]) << ", " << quote(formulas[2]) << "},\n"
+        << "    " << quote(sources->functions) << ",\n"
+        << "};\n";
+    if (!out.flush()) {
+        std::fprintf(stderr, "can't write %s\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Checks the functions climate_codegen generated from config.json, next to this file, against the runtime
+// engine: every generated formula must give the same bits as Program::evalFirst, and the formulas that
+// need the tuple interpreter must have been left out.
+//
+// Usage: codegen_test
+
+#include "expr/Codegen.hpp"
+#include "expr/Expr.hpp"
+#include "expr/Verify.hpp"
+
+#include <cstdio>
+#include <vector>
+
+namespace {
+constexpr const char* output_names[] = {"factor", "jaggedness", "offset"};
+// Whether config.json's formula can be compiled ahead of time.
+constexpr bool expect_generated[] = {true, false, true};
+
+int failures = 0;
+
+void fail(const char* output, const char* message) {
+    std::fprintf(stderr, "%s: %s\n", output, message);
+    failures++;
+}
+} // namespace
+
+int main() {
+    auto& generated = expr::codegen::generated;
+    auto& sources   = generated.sources;
+    if (generated.hash != expr::codegen::hash(sources[0], sources[1], sources[2], generated.definitions)) {
+        fail("config", "the hash doesn't match the sources");
+    }
+
+    expr::FunctionTable functions{
+        {"info", [](const std::vector<std::vector<float>>& args) {
+             return args.empty() ? std::vector<float>{} : args[0];
+         }}
+    };
+    auto definitions = expr::define(generated.definitions, functions);
+    if (!definitions) {
+        fail("functions", "don't parse");
+        return 1;
+    }
+    for (std::size_t o = 0; o < 3; o++) {
+        auto name     = output_names[o];
+        auto function = generated.functions[o];
+        if ((function != nullptr) != expect_generated[o]) {
+            fail(name, expect_generated[o] ? "was not generated" : "was generated but needs the tuple interpreter");
+        }
+        auto program = expr::compile(sources[o], functions, nullptr, *definitions);
+        if (!program) {
+            fail(name, "doesn't compile");
+            continue;
+        }
+        if (!function) continue;
+        if (!expr::codegen::matches(*program, function)) fail(name, "differs on random or special inputs");
+        // A grid over the ranges the game uses, with vanilla values around the real ones.
+        constexpr int steps = 24;
+        for (int i = 0; i <= steps; i++) {
+            for (int j = 0; j <= steps; j++) {
+                for (int k = 0; k <= steps; k++) {
+                    auto c   = -1.2f + 2.4f * static_cast<float>(i) / steps;
+                    auto e   = -1.0f + 2.0f * static_cast<float>(j) / steps;
+                    auto w   = -1.0f + 2.0f * static_cast<float>(k) / steps;
+                    auto ori = 0.5f * c - 0.25f * e * w;
+                    if (!expr::verify::same(function(ori, c, e, w), program->evalFirst({ori, c, e, w}, ori))) {
+                        std::fprintf(stderr, "%s: differs at (%g, %g, %g, %g)\n", name, ori, c, e, w);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    if (failures) return 1;
+    std::printf("generated formulas match the interpreter\n");
+    return 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace expr {
+/// Bump allocator handing out memory from a few large blocks. Nothing is freed individually: objects
+/// live until reset() or the arena's destruction, which also run their destructors in reverse order.
+/// reset() keeps the blocks, so an arena that is reused for similar work stops allocating.
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&)            = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { reset(); }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        auto object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            mDestructors.push_back({object, [](void* p) { static_cast<T*>(p)->~T(); }});
+        }
+        return object;
+    }
+
+    /// `count` value-initialized elements.
+    template <typename T>
+    std::span<T> array(std::size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        if (count == 0) return {};
+        auto data = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (std::size_t i = 0; i < count; i++) new (data + i) T();
+        return {data, count};
+    }
+
+    void reset() {
+        for (auto it = mDestructors.rbegin(); it != mDestructors.rend(); ++it) it->destroy(it->object);
+        mDestructors.clear();
+        mBlock     = 0;
+        mUsed      = 0;
+        mAllocated = 0;
+    }
+
+    /// Bytes handed out since the last reset(), not counting alignment.
+    [[nodiscard]] std::size_t allocated() const { return mAllocated; }
+
+private:
+    static constexpr std::size_t block_size = 16 * 1024;
+
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        std::size_t                  size;
+    };
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    void* allocate(std::size_t size, std::size_t align) {
+        mAllocated += size;
+        while (mBlock < mBlocks.size()) {
+            auto offset = (mUsed + align - 1) & ~(align - 1);
+            if (offset + size <= mBlocks[mBlock].size) {
+                mUsed = offset + size;
+                return mBlocks[mBlock].data.get() + offset;
+            }
+            mBlock++;
+            mUsed = 0;
+        }
+        // Blocks come from operator new[], which is aligned for any fundamental type.
+        auto capacity = std::max(block_size, size);
+        mBlocks.push_back({std::make_unique<std::byte[]>(capacity), capacity});
+        mUsed = size;
+        return mBlocks.back().data.get();
+    }
+
+    std::vector<Block>      mBlocks;
+    std::size_t             mBlock     = 0; // block allocations currently come from
+    std::size_t             mUsed      = 0; // bytes used in that block
+    std::size_t             mAllocated = 0;
+    std::vector<Destructor> mDestructors;
+};
+} // namespace expr
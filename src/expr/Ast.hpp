@@ -0,0 +1,159 @@
+#pragma once
+#include "Expr.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace expr {
+namespace bytecode {
+struct Builder;
+}
+
+/// Built-in functions the compiler knows the semantics of. User functions are always `None`,
+/// even when they shadow a built-in name.
+enum class Builtin : std::uint8_t {
+    None,
+    Tuple,
+    Subtuple,
+    Len,
+    Of,
+    Sum,
+    Con,
+    Max,
+    Min,
+    Sort,
+    Push,
+    Pop,
+    Abs,
+    Clamp,
+    Lerp,
+    Pow,
+    Sqrt,
+    Exp,
+    Smoothstep,
+    Spline,
+    Neg, // unary minus, which has no name to call it by
+};
+
+/// Bytes [begin, end) of the code a node was parsed from.
+struct Source {
+    std::uint32_t begin = 0;
+    std::uint32_t end   = 0;
+};
+
+struct Frame {
+    const Slots&                            slots;
+    EvalContext::State&                     state;
+    std::span<const std::span<const float>> args = {}; // of the definition being evaluated
+};
+/// Nodes are allocated from their program's Arena, which destroys them; they don't own their children.
+struct Expr {
+    Source source; // set by the parser; profiles attribute the node's cost to it
+
+    virtual ~Expr() = default;
+    /// The value is data owned by a node, a view of the frame's slots or allocated from its scratch arena.
+    virtual std::span<const float> eval(const Frame& frame) const = 0;
+    /// Appends the instructions computing this node and returns the register holding its value.
+    virtual std::uint16_t lower(bytecode::Builder& builder) const = 0;
+};
+struct BinaryOperatorExpr : Expr {
+    Expr* a;
+    Expr* b;
+    BinaryOperatorExpr(Expr*, Expr*);
+    ~BinaryOperatorExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override = 0;
+};
+struct AddExpr : BinaryOperatorExpr {
+    AddExpr(Expr* a, Expr* b);
+    virtual ~AddExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+struct SubExpr : BinaryOperatorExpr {
+    SubExpr(Expr* a, Expr* b);
+    virtual ~SubExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+struct MulExpr : BinaryOperatorExpr {
+    MulExpr(Expr* a, Expr* b);
+    virtual ~MulExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+struct DivExpr : BinaryOperatorExpr {
+    DivExpr(Expr* a, Expr* b);
+    virtual ~DivExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+struct TupleExpr : Expr {
+    std::vector<float> data;
+    TupleExpr(const std::vector<float>&);
+    virtual ~TupleExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+struct ParamExpr : Expr {
+    Slot slot;
+    ParamExpr(Slot);
+    virtual ~ParamExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+/// Reads a local variable; `index` is resolved at compile time.
+struct LocalExpr : Expr {
+    std::uint16_t index;
+    LocalExpr(std::uint16_t);
+    virtual ~LocalExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+/// `name = value`: stores the value in local `index` and evaluates to it.
+struct AssignExpr : Expr {
+    std::uint16_t index;
+    Expr*         value;
+    AssignExpr(std::uint16_t, Expr*);
+    virtual ~AssignExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+struct CallExpr : Expr {
+    const Function*    function; // user functions only; built-ins are dispatched on `builtin`
+    Builtin            builtin;
+    std::vector<Expr*> args;
+    std::uint32_t      offset; // of the name in the source, for errors found after parsing
+    CallExpr(const Function*, Builtin, std::vector<Expr*>, std::uint32_t);
+    virtual ~CallExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+/// Reads parameter `index` of the definition whose body this is.
+struct ArgExpr : Expr {
+    std::uint16_t index;
+    ArgExpr(std::uint16_t);
+    virtual ~ArgExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+/// `name(params) = body`, shared by the programs compiled with the Definitions holding it.
+struct Definition {
+    std::string_view name;
+    std::uint16_t    params;
+    Expr*            body;
+    std::size_t      size;   // nodes once every call in `body` is inlined
+    std::size_t      height; // of `body` once inlined, which lowering and the tree walker recurse through
+};
+/// A call to a definition. Lowering inlines the body with the parameters bound to the registers of the
+/// arguments, so the bytecode has no call left; the tree walker evaluates the body in a frame of its own.
+struct InlineExpr : Expr {
+    const Definition*  definition;
+    std::vector<Expr*> args;
+    InlineExpr(const Definition*, std::vector<Expr*>);
+    virtual ~InlineExpr() override;
+    virtual std::span<const float> eval(const Frame& frame) const override;
+    virtual std::uint16_t          lower(bytecode::Builder& builder) const override;
+};
+} // namespace expr
@@ -0,0 +1,136 @@
+#include "Batch.hpp"
+#include "EvalState.hpp"
+#include "Kernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace expr::batch {
+namespace {
+constexpr std::size_t slot_count = static_cast<std::size_t>(Slot::Count);
+constexpr auto        never      = std::numeric_limits<std::size_t>::max();
+} // namespace
+
+Plan plan(const scalar::Chunk& chunk) {
+    Plan res;
+    res.constants   = chunk.constants;
+    res.splines     = chunk.splines;
+    auto temp_base  = slot_count + chunk.constants.size();
+    auto temp_count = chunk.registers - temp_base;
+
+    std::vector<std::size_t> last_use(temp_count, 0);
+    for (std::size_t i = 0; i < chunk.code.size(); i++) {
+        auto& instr = chunk.code[i];
+        for (auto reg : {instr.a, instr.b}) {
+            if (reg >= temp_base) last_use[reg - temp_base] = i;
+            if (!scalar::reads_b(instr.op)) break;
+        }
+    }
+    if (!chunk.results.empty() && chunk.results[0] >= temp_base) last_use[chunk.results[0] - temp_base] = never;
+
+    // Linear scan: operands whose last use is this step are released before the destination is
+    // picked, so an op can write over its own input.
+    std::vector<std::uint16_t> buffer(temp_count, 0);
+    std::vector<std::uint16_t> free_buffers;
+    auto operand = [&](std::uint16_t reg) {
+        return reg < temp_base ? reg : static_cast<std::uint16_t>(temp_base + buffer[reg - temp_base]);
+    };
+    for (std::size_t i = 0; i < chunk.code.size(); i++) {
+        auto& instr = chunk.code[i];
+        auto  a     = operand(instr.a);
+        auto  b     = scalar::reads_b(instr.op) ? operand(instr.b) : instr.b;
+        for (auto reg : {instr.a, instr.b}) {
+            if (reg >= temp_base && last_use[reg - temp_base] == i) {
+                auto buf = buffer[reg - temp_base];
+                if (std::find(free_buffers.begin(), free_buffers.end(), buf) == free_buffers.end()) {
+                    free_buffers.push_back(buf);
+                }
+            }
+            if (!scalar::reads_b(instr.op)) break;
+        }
+        std::uint16_t dst;
+        if (free_buffers.empty()) {
+            dst = res.temps++;
+        } else {
+            dst = free_buffers.back();
+            free_buffers.pop_back();
+        }
+        buffer[instr.dst - temp_base] = dst;
+        // A result nobody reads still needs a buffer, but it can be handed out again right away.
+        if (last_use[instr.dst - temp_base] == 0) free_buffers.push_back(dst);
+        res.steps.push_back({instr.op, dst, a, b});
+    }
+    if (!chunk.results.empty()) {
+        res.empty  = false;
+        res.result = operand(chunk.results[0]);
+    }
+    return res;
+}
+
+void run(const Plan& plan, const Inputs& inputs, float* out, std::size_t n, EvalContext::State& state) {
+    auto& kernels = kernels::table();
+    auto  base    = slot_count + plan.constants.size();
+
+    auto& storage = state.blocks;
+    storage.resize((plan.constants.size() + plan.temps) * block_size);
+    for (std::size_t i = 0; i < plan.constants.size(); i++) {
+        std::fill_n(storage.data() + i * block_size, block_size, plan.constants[i]);
+    }
+    auto temp = [&](std::uint16_t buf) { return storage.data() + (plan.constants.size() + buf) * block_size; };
+
+    auto& operands = state.operands;
+    operands.resize(base + plan.temps);
+    for (std::size_t i = 0; i < plan.constants.size(); i++) operands[slot_count + i] = storage.data() + i * block_size;
+    for (std::uint16_t i = 0; i < plan.temps; i++) operands[base + i] = temp(i);
+
+    for (std::size_t offset = 0; offset < n; offset += block_size) {
+        auto count = std::min(block_size, n - offset);
+        for (std::size_t i = 0; i < slot_count; i++) operands[i] = inputs[i] + offset;
+        for (auto& step : plan.steps) {
+            auto a   = operands[step.a];
+            auto b   = scalar::reads_b(step.op) ? operands[step.b] : nullptr;
+            auto dst = temp(step.dst);
+            switch (step.op) {
+            case scalar::Op::Add:
+                kernels.add(a, b, dst, count);
+                break;
+            case scalar::Op::Sub:
+                kernels.sub(a, b, dst, count);
+                break;
+            case scalar::Op::Mul:
+                kernels.mul(a, b, dst, count);
+                break;
+            case scalar::Op::Div:
+                kernels.div(a, b, dst, count);
+                break;
+            case scalar::Op::Max:
+                kernels.max(a, b, dst, count);
+                break;
+            case scalar::Op::Min:
+                kernels.min(a, b, dst, count);
+                break;
+            case scalar::Op::Pow:
+                kernels.pow(a, b, dst, count);
+                break;
+            case scalar::Op::Abs:
+                kernels.abs(a, dst, count);
+                break;
+            case scalar::Op::Sqrt:
+                kernels.sqrt(a, dst, count);
+                break;
+            case scalar::Op::Exp:
+                kernels.exp(a, dst, count);
+                break;
+            case scalar::Op::Spline: {
+                auto& spline = plan.splines[step.b];
+                for (std::size_t i = 0; i < count; i++) dst[i] = spline(a[i]);
+                break;
+            }
+            }
+        }
+        auto result = plan.empty ? operands[static_cast<std::size_t>(Slot::Ori)] : operands[plan.result];
+        std::memcpy(out + offset, result, count * sizeof(float));
+    }
+}
+} // namespace expr::batch
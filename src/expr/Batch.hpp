@@ -0,0 +1,38 @@
+#pragma once
+#include "Expr.hpp"
+#include "Scalar.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace expr::batch {
+/// Samples processed per kernel call. Each live temporary needs one block of this many floats.
+inline constexpr std::size_t block_size = 256;
+
+/// A scalar::Chunk rearranged for structure-of-arrays evaluation. Temporaries share buffers once their
+/// last reader has run, which keeps the working set of a block small enough to stay in cache.
+struct Plan {
+    struct Step {
+        scalar::Op    op;
+        std::uint16_t dst; // temporary buffer
+        std::uint16_t a;   // inputs, then constants, then temporaries
+        std::uint16_t b;   // or a spline index, as in scalar::Instr
+    };
+    std::vector<float>  constants;
+    std::vector<Spline> splines;
+    std::vector<Step>   steps;
+    std::uint16_t       temps  = 0;
+    bool                empty  = true; // the program's value has no elements
+    std::uint16_t       result = 0;    // operand index, valid unless `empty`
+};
+
+Plan plan(const scalar::Chunk& chunk);
+
+/// One array per slot.
+using Inputs = std::array<const float*, static_cast<std::size_t>(Slot::Count)>;
+
+/// out[i] = value of the program for sample i, or inputs[Ori][i] when the value is empty.
+void run(const Plan& plan, const Inputs& inputs, float* out, std::size_t n, EvalContext::State& state);
+} // namespace expr::batch
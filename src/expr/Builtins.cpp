@@ -0,0 +1,213 @@
+#include "Builtins.hpp"
+#include "Spline.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace expr::builtins {
+namespace {
+// Indexed by Builtin.
+constexpr std::array<std::string_view, 21> names{
+    "",
+    "tuple",
+    "subtuple",
+    "len",
+    "of",
+    "sum",
+    "con",
+    "max",
+    "min",
+    "sort",
+    "push",
+    "pop",
+    "abs",
+    "clamp",
+    "lerp",
+    "pow",
+    "sqrt",
+    "exp",
+    "smoothstep",
+    "spline",
+    "-", // not a name, so find() never returns Neg
+};
+static_assert(names.size() == static_cast<std::size_t>(Builtin::Neg) + 1, "a built-in has no name");
+
+constexpr int         bucket_bits = 6;
+constexpr std::size_t buckets     = std::size_t{1} << bucket_bits;
+
+// FNV-1a with the seed mixed into the offset basis. The low bits of FNV only depend on the low bits of
+// its input, so the bucket comes from the top ones.
+constexpr std::size_t hash(std::string_view name, std::uint32_t seed) {
+    std::uint32_t h = 2166136261u ^ seed;
+    for (auto c : name) {
+        h ^= static_cast<std::uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h >> (32 - bucket_bits);
+}
+
+// The first seed that gives every name a bucket of its own.
+constexpr std::uint32_t perfect_seed() {
+    for (std::uint32_t seed = 0;; seed++) {
+        std::array<bool, buckets> used{};
+        bool                      collision = false;
+        for (std::size_t i = 1; i < names.size() && !collision; i++) {
+            auto bucket  = hash(names[i], seed);
+            collision    = used[bucket];
+            used[bucket] = true;
+        }
+        if (!collision) return seed;
+    }
+}
+constexpr std::uint32_t seed = perfect_seed();
+
+// Empty buckets hold Builtin::None, whose name matches nothing that reaches the lookup.
+constexpr std::array<Builtin, buckets> table = [] {
+    std::array<Builtin, buckets> res{};
+    for (std::size_t i = 1; i < names.size(); i++) res[hash(names[i], seed)] = static_cast<Builtin>(i);
+    return res;
+}();
+
+// Missing arguments read as empty tuples and missing elements as 0, so a malformed call yields a value
+// instead of reading out of bounds. Results of max, min and of always have one element.
+std::span<const float> arg(Args args, std::size_t i) { return i < args.size() ? args[i] : std::span<const float>{}; }
+float                  first(Args args, std::size_t i) { return arg(args, i).empty() ? 0.0f : arg(args, i)[0]; }
+std::span<const float> one(Arena& scratch, float value) {
+    auto res = scratch.array<float>(1);
+    res[0]   = value;
+    return res;
+}
+
+// Elementwise over the first N arguments, up to the shortest like the arithmetic operators.
+template <std::size_t N, typename F>
+std::span<const float> elementwise(Args args, Arena& scratch, F f) {
+    std::size_t size = std::numeric_limits<std::size_t>::max();
+    for (std::size_t i = 0; i < N; i++) size = std::min(size, arg(args, i).size());
+    auto res = scratch.array<float>(size);
+    for (std::size_t i = 0; i < size; i++) {
+        if constexpr (N == 1) res[i] = f(args[0][i]);
+        else if constexpr (N == 2) res[i] = f(args[0][i], args[1][i]);
+        else res[i] = f(args[0][i], args[1][i], args[2][i]);
+    }
+    return res;
+}
+} // namespace
+
+std::size_t count(float value) {
+    constexpr float limit = 1 << 24;
+    return value > 0.0f ? static_cast<std::size_t>(std::min(value, limit)) : 0;
+}
+
+Builtin find(std::string_view name) {
+    auto builtin = table[hash(name, seed)];
+    return builtin != Builtin::None && names[static_cast<std::size_t>(builtin)] == name ? builtin : Builtin::None;
+}
+
+std::string_view name(Builtin builtin) { return names[static_cast<std::size_t>(builtin)]; }
+
+std::vector<float> fold(Builtin builtin, const std::vector<std::vector<float>>& args) {
+    Arena                               scratch;
+    std::vector<std::span<const float>> values(args.begin(), args.end());
+    auto                                res = call(builtin, values, scratch);
+    return {res.begin(), res.end()};
+}
+
+std::span<const float> call(Builtin builtin, Args args, Arena& scratch) {
+    switch (builtin) {
+    case Builtin::Tuple: {
+        auto res  = scratch.array<float>(count(first(args, 0)));
+        auto fill = first(args, 1);
+        for (auto& v : res) v = fill;
+        return res;
+    }
+    case Builtin::Subtuple: {
+        // Element i of t lands at position i of the b - a results, so only a == 0 gives a plain slice;
+        // positions past the end are dropped.
+        auto begin = count(first(args, 0));
+        auto end   = count(first(args, 1));
+        auto t     = arg(args, 2);
+        if (begin == 0 && end <= t.size()) return t.first(end);
+        auto res = scratch.array<float>(end > begin ? end - begin : 0);
+        for (auto i = begin; i < end && i < res.size() && i < t.size(); i++) res[i] = t[i];
+        return res;
+    }
+    case Builtin::Len: {
+        auto res = scratch.array<float>(args.size());
+        for (std::size_t i = 0; i < args.size(); i++) res[i] = static_cast<float>(args[i].size());
+        return res;
+    }
+    case Builtin::Of: {
+        auto t     = arg(args, 1);
+        auto index = count(first(args, 0));
+        return index < t.size() ? t.subspan(index, 1) : one(scratch, 0.0f);
+    }
+    case Builtin::Sum: {
+        float sum = 0;
+        for (auto v : arg(args, 0)) sum += v;
+        return one(scratch, sum);
+    }
+    case Builtin::Con: {
+        // Only a concatenation of two or more non-empty tuples needs new storage.
+        std::size_t size = 0, nonempty = 0;
+        for (auto a : args) {
+            size     += a.size();
+            nonempty += !a.empty();
+        }
+        if (nonempty <= 1) {
+            for (auto a : args) {
+                if (!a.empty()) return a;
+            }
+            return {};
+        }
+        auto res = scratch.array<float>(size);
+        auto out = res.begin();
+        for (auto a : args) out = std::copy(a.begin(), a.end(), out);
+        return res;
+    }
+    case Builtin::Max: {
+        auto t = arg(args, 0);
+        return one(scratch, t.empty() ? 0.0f : *std::max_element(t.begin(), t.end()));
+    }
+    case Builtin::Min: {
+        auto t = arg(args, 0);
+        return one(scratch, t.empty() ? 0.0f : *std::min_element(t.begin(), t.end()));
+    }
+    case Builtin::Sort: {
+        auto t   = arg(args, 0);
+        auto res = scratch.array<float>(t.size());
+        std::copy(t.begin(), t.end(), res.begin());
+        std::sort(res.begin(), res.end());
+        return res;
+    }
+    case Builtin::Abs:
+        return elementwise<1>(args, scratch, [](float x) { return std::fabs(x); });
+    case Builtin::Neg:
+        return elementwise<1>(args, scratch, [](float x) { return -x; });
+    case Builtin::Sqrt:
+        return elementwise<1>(args, scratch, [](float x) { return std::sqrt(x); });
+    case Builtin::Exp:
+        return elementwise<1>(args, scratch, [](float x) { return std::exp(x); });
+    case Builtin::Pow:
+        return elementwise<2>(args, scratch, [](float x, float y) { return std::pow(x, y); });
+    case Builtin::Clamp:
+        return elementwise<3>(args, scratch, clamp);
+    case Builtin::Lerp:
+        return elementwise<3>(args, scratch, lerp);
+    case Builtin::Smoothstep:
+        return elementwise<3>(args, scratch, smoothstep);
+    case Builtin::Spline: {
+        // spline(x, points...): the points may be split over any number of arguments, as with con.
+        auto points = call(Builtin::Con, args.size() > 1 ? args.subspan(1) : Args{}, scratch);
+        auto x      = arg(args, 0);
+        auto res    = scratch.array<float>(x.size());
+        for (std::size_t i = 0; i < x.size(); i++) res[i] = spline(points, x[i]);
+        return res;
+    }
+    default:
+        return {};
+    }
+}
+} // namespace expr::builtins
@@ -0,0 +1,39 @@
+#pragma once
+#include "Arena.hpp"
+#include "Ast.hpp"
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace expr::builtins {
+using Args = std::span<const std::span<const float>>;
+
+/// The built-in called `name`, or Builtin::None. A perfect hash computed at compile time finds the only
+/// candidate, so this is one hash and one string comparison.
+Builtin find(std::string_view name);
+/// How `builtin` is written in a formula, "-" for Neg.
+std::string_view name(Builtin builtin);
+
+/// Evaluates a built-in other than push and pop, which need the EvalContext. The result is either a view
+/// into one of `args` (con, of and subtuple return slices of their arguments when they can) or allocated
+/// from `scratch`, and stays valid as long as both do.
+std::span<const float> call(Builtin builtin, Args args, Arena& scratch);
+/// call() on values known at load time, for constant folding.
+std::vector<float> fold(Builtin builtin, const std::vector<std::vector<float>>& args);
+/// A length or index argument as the built-ins read it: truncated, with negative and NaN values counting
+/// as 0 and huge ones capped.
+std::size_t count(float value);
+
+// The elementwise math built-ins on one element. Every backend computes them through these, or through
+// the same sequence of float operations, so they all round alike.
+inline float clamp(float x, float lo, float hi) {
+    auto low = x < lo ? lo : x; // scalar::Op::Max
+    return hi < low ? hi : low; // scalar::Op::Min
+}
+inline float lerp(float a, float b, float t) { return a + t * (b - a); }
+inline float smoothstep(float edge0, float edge1, float x) {
+    auto t = clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+} // namespace expr::builtins
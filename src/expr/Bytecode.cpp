@@ -0,0 +1,318 @@
+#include "Bytecode.hpp"
+#include "Ast.hpp"
+#include "Builtins.hpp"
+#include "EvalState.hpp"
+#include "Kernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <utility>
+
+namespace expr::bytecode {
+std::uint16_t Builder::emit(Op op, Source source, std::uint16_t a, std::uint16_t b) {
+    if (chunk.registers == std::numeric_limits<std::uint16_t>::max()) {
+        if (error.empty()) error = "program is too large";
+        return 0;
+    }
+    auto dst = chunk.registers++;
+    chunk.code.push_back({op, dst, a, b});
+    chunk.sources.push_back(site.value_or(source));
+    return dst;
+}
+std::uint16_t Builder::constant(const std::vector<float>& value, Source source) {
+    chunk.constants.push_back(value);
+    return emit(Op::Const, source, static_cast<std::uint16_t>(chunk.constants.size() - 1));
+}
+std::uint16_t Builder::call(
+    const Function*                   function,
+    Builtin                           builtin,
+    const std::vector<std::uint16_t>& args,
+    std::uint32_t                     offset,
+    Source                            source
+) {
+    // Errors in an inlined body point at the call, which is in the code they are reported against.
+    chunk.calls.push_back(
+        {function,
+         builtin,
+         static_cast<std::uint32_t>(chunk.operands.size()),
+         static_cast<std::uint32_t>(args.size()),
+         site ? site->begin : offset}
+    );
+    chunk.operands.insert(chunk.operands.end(), args.begin(), args.end());
+    return emit(Op::Call, source, static_cast<std::uint16_t>(chunk.calls.size() - 1));
+}
+
+bool lower(Chunk& chunk, const std::vector<Expr*>& statements, std::string* error) {
+    Builder builder{chunk, {}, {}, {}, {}};
+    for (auto statement : statements) chunk.result = statement->lower(builder);
+    if (chunk.constants.size() > std::numeric_limits<std::uint16_t>::max()
+        || chunk.calls.size() > std::numeric_limits<std::uint16_t>::max()) {
+        builder.error = "program is too large";
+    }
+    if (builder.error.empty()) return true;
+    if (error) *error = std::move(builder.error);
+    return false;
+}
+
+namespace {
+// A length the optimizer proved: both operands have at least N elements, so the loop needs no bounds and
+// unrolls completely.
+template <std::size_t N, typename F>
+std::span<const float> fixed(Arena& scratch, const float* a, const float* b, F f) {
+    auto res = scratch.array<float>(N);
+    for (std::size_t i = 0; i < N; i++) res[i] = f(a[i], b[i]);
+    return res;
+}
+
+// `length` is the result's length if it is known at compile time, or -1.
+template <typename F>
+std::span<const float>
+elementwise(Arena& scratch, int length, std::span<const float> a, std::span<const float> b, F f) {
+    switch (length) {
+    case 0:
+        return {};
+    case 1:
+        return fixed<1>(scratch, a.data(), b.data(), f);
+    case 2:
+        return fixed<2>(scratch, a.data(), b.data(), f);
+    case 3:
+        return fixed<3>(scratch, a.data(), b.data(), f);
+    case 4:
+        return fixed<4>(scratch, a.data(), b.data(), f);
+    default:
+        break;
+    }
+    auto res = scratch.array<float>(std::min(a.size(), b.size()));
+    for (std::size_t i = 0; i < res.size(); i++) res[i] = f(a[i], b[i]);
+    return res;
+}
+
+// Elements per pass over a loop's operations; each temporary needs a buffer this long.
+constexpr std::size_t loop_block = 256;
+// Below this many elements an indirect call to a SIMD kernel costs more than it saves.
+constexpr std::size_t kernel_threshold = 8;
+
+float apply(Op op, float x, float y) {
+    switch (op) {
+    case Op::Add:
+        return x + y;
+    case Op::Sub:
+        return x - y;
+    case Op::Mul:
+        return x * y;
+    default:
+        return x / y;
+    }
+}
+
+// Runs the operations of a loop block by block on the SIMD kernels. The temporaries of a block stay in
+// cache, so memory only sees the inputs read once and the result written once. `length` is the result's
+// length if it is known at compile time, or -1 to take the shortest input.
+std::span<const float> run_loop(
+    const Chunk&                            chunk,
+    const Loop&                             loop,
+    std::span<const std::span<const float>> registers,
+    int                                     length,
+    Arena&                                  scratch
+) {
+    auto        input = [&](std::uint32_t i) { return registers[chunk.operands[loop.first + i]]; };
+    std::size_t size  = length >= 0 ? static_cast<std::size_t>(length) : std::numeric_limits<std::size_t>::max();
+    if (length < 0) {
+        for (std::uint32_t i = 0; i < loop.count; i++) size = std::min(size, input(i).size());
+    }
+    auto  res      = scratch.array<float>(size);
+    auto  block    = std::min(size, loop_block);
+    auto  temps    = scratch.array<float>(loop.temps * block);
+    auto  operands = scratch.array<const float*>(loop.count + loop.temps);
+    auto& kernels  = kernels::table();
+    for (std::size_t offset = 0; offset < size; offset += block) {
+        auto count = std::min(block, size - offset);
+        for (std::uint32_t i = 0; i < loop.count; i++) operands[i] = input(i).data() + offset;
+        for (std::size_t i = 0; i < loop.code.size(); i++) {
+            auto& step = loop.code[i];
+            auto  dst  = i + 1 == loop.code.size() ? res.data() + offset : temps.data() + step.dst * block;
+            auto  a    = operands[step.a];
+            auto  b    = operands[step.b];
+            if (count < kernel_threshold) {
+                for (std::size_t j = 0; j < count; j++) dst[j] = apply(step.op, a[j], b[j]);
+            } else {
+                auto kernel = step.op == Op::Add ? kernels.add
+                            : step.op == Op::Sub ? kernels.sub
+                            : step.op == Op::Mul ? kernels.mul
+                                                 : kernels.div;
+                kernel(a, b, dst, count);
+            }
+            operands[loop.count + step.dst] = dst;
+        }
+    }
+    return res;
+}
+
+std::int64_t clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+// What timing an operation costs when it does nothing: the least of a few back-to-back clock reads.
+std::int64_t clock_overhead() {
+    static const std::int64_t overhead = [] {
+        auto res = std::numeric_limits<std::int64_t>::max();
+        for (int i = 0; i < 64; i++) {
+            auto begin = clock_ns();
+            res        = std::min(res, clock_ns() - begin);
+        }
+        return res;
+    }();
+    return overhead;
+}
+
+// With a profile, every operation but Const and Param is timed and its scratch allocations counted.
+template <bool profiled>
+std::span<const float>
+execute(const Chunk& chunk, const Slots& slots, EvalContext::State& state, Profile* profile = nullptr) {
+    auto& registers = state.registers;
+    auto& scratch   = state.scratch;
+    if (registers.size() < chunk.registers) registers.resize(chunk.registers);
+    auto length = [&](std::uint16_t reg) { return reg < chunk.lengths.size() ? chunk.lengths[reg] : -1; };
+    if constexpr (profiled) {
+        if (profile->operations.size() < chunk.registers) profile->operations.resize(chunk.registers);
+        profile->evaluations++;
+    }
+    for (auto& instr : chunk.code) {
+        auto&        dst   = registers[instr.dst];
+        std::int64_t begin = 0;
+        std::size_t  bytes = 0;
+        if constexpr (profiled) {
+            if (instr.op != Op::Const && instr.op != Op::Param) {
+                bytes = scratch.allocated();
+                begin = clock_ns();
+            }
+        }
+        switch (instr.op) {
+        case Op::Const:
+            dst = chunk.constants[instr.a];
+            break;
+        case Op::Param:
+            dst = {&slots[instr.a], 1};
+            break;
+        case Op::Add:
+            dst = elementwise(scratch, length(instr.dst), registers[instr.a], registers[instr.b], std::plus<>{});
+            break;
+        case Op::Sub:
+            dst = elementwise(scratch, length(instr.dst), registers[instr.a], registers[instr.b], std::minus<>{});
+            break;
+        case Op::Mul:
+            dst = elementwise(scratch, length(instr.dst), registers[instr.a], registers[instr.b], std::multiplies<>{});
+            break;
+        case Op::Div:
+            dst = elementwise(scratch, length(instr.dst), registers[instr.a], registers[instr.b], std::divides<>{});
+            break;
+        case Op::Call: {
+            auto& call = chunk.calls[instr.a];
+            auto  args = scratch.array<std::span<const float>>(call.count);
+            for (std::uint32_t i = 0; i < call.count; i++) args[i] = registers[chunk.operands[call.first + i]];
+            switch (call.builtin) {
+            case Builtin::Push:
+                if (args.empty()) {
+                    dst = {};
+                    break;
+                }
+                state.push(args[0]);
+                dst = args[0];
+                break;
+            case Builtin::Pop:
+                dst = state.pop();
+                break;
+            case Builtin::None:
+                dst = state.invoke(*call.function, args);
+                break;
+            default:
+                dst = builtins::call(call.builtin, args, scratch);
+                break;
+            }
+            break;
+        }
+        case Op::Loop:
+            dst = run_loop(chunk, chunk.loops[instr.a], registers, length(instr.dst), scratch);
+            break;
+        }
+        if constexpr (profiled) {
+            if (instr.op != Op::Const && instr.op != Op::Param) {
+                auto  ns         = clock_ns() - begin - clock_overhead();
+                auto& operation  = profile->operations[instr.dst];
+                operation.calls += 1;
+                operation.ns    += static_cast<std::uint64_t>(std::max<std::int64_t>(ns, 0));
+                operation.bytes += scratch.allocated() - bytes;
+            }
+        }
+    }
+    return registers[chunk.result];
+}
+} // namespace
+
+std::span<const float> run(const Chunk& chunk, const Slots& slots, EvalContext::State& state) {
+    return execute<false>(chunk, slots, state);
+}
+
+std::span<const float> run(const Chunk& chunk, const Slots& slots, EvalContext::State& state, Profile& profile) {
+    return execute<true>(chunk, slots, state, &profile);
+}
+} // namespace expr::bytecode
+
+namespace expr {
+std::uint16_t AddExpr::lower(bytecode::Builder& builder) const {
+    auto x = a->lower(builder);
+    auto y = b->lower(builder);
+    return builder.emit(bytecode::Op::Add, source, x, y);
+}
+std::uint16_t SubExpr::lower(bytecode::Builder& builder) const {
+    auto x = a->lower(builder);
+    auto y = b->lower(builder);
+    return builder.emit(bytecode::Op::Sub, source, x, y);
+}
+std::uint16_t MulExpr::lower(bytecode::Builder& builder) const {
+    auto x = a->lower(builder);
+    auto y = b->lower(builder);
+    return builder.emit(bytecode::Op::Mul, source, x, y);
+}
+std::uint16_t DivExpr::lower(bytecode::Builder& builder) const {
+    auto x = a->lower(builder);
+    auto y = b->lower(builder);
+    return builder.emit(bytecode::Op::Div, source, x, y);
+}
+std::uint16_t TupleExpr::lower(bytecode::Builder& builder) const { return builder.constant(data, source); }
+std::uint16_t ParamExpr::lower(bytecode::Builder& builder) const {
+    return builder.emit(bytecode::Op::Param, source, static_cast<std::uint16_t>(slot));
+}
+// Every register keeps its value for the whole run, so a local is just the register of its value.
+std::uint16_t LocalExpr::lower(bytecode::Builder& builder) const { return builder.locals[index]; }
+std::uint16_t AssignExpr::lower(bytecode::Builder& builder) const {
+    auto reg = value->lower(builder);
+    if (builder.locals.size() <= index) builder.locals.resize(index + 1u);
+    builder.locals[index] = reg;
+    return reg;
+}
+std::uint16_t ArgExpr::lower(bytecode::Builder& builder) const { return builder.args[index]; }
+std::uint16_t InlineExpr::lower(bytecode::Builder& builder) const {
+    std::vector<std::uint16_t> regs;
+    regs.reserve(args.size());
+    for (auto arg : args) regs.push_back(arg->lower(builder));
+    auto outer = std::exchange(builder.args, std::move(regs));
+    auto site  = builder.site;
+    if (!site) builder.site = source;
+    auto res     = definition->body->lower(builder);
+    builder.args = std::move(outer);
+    builder.site = site;
+    return res;
+}
+std::uint16_t CallExpr::lower(bytecode::Builder& builder) const {
+    std::vector<std::uint16_t> regs;
+    regs.reserve(args.size());
+    for (auto arg : args) regs.push_back(arg->lower(builder));
+    return builder.call(function, builtin, regs, offset, source);
+}
+} // namespace expr
@@ -0,0 +1,104 @@
+#pragma once
+#include "Ast.hpp"
+#include "Expr.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace expr::bytecode {
+enum class Op : std::uint8_t {
+    Const, // dst = constants[a]
+    Param, // dst = {slots[a]}
+    Add,   // dst = a + b, elementwise up to the shorter operand
+    Sub,
+    Mul,
+    Div,
+    Call, // dst = calls[a].function(operands[calls[a].first .. + calls[a].count])
+    Loop, // dst = loops[a] run over its inputs
+};
+
+struct Instr {
+    Op            op;
+    std::uint16_t dst;
+    std::uint16_t a;
+    std::uint16_t b;
+};
+
+struct Call {
+    const Function* function;
+    Builtin         builtin;
+    std::uint32_t   first;
+    std::uint32_t   count;
+    std::uint32_t   offset; // of the call in the source
+};
+
+/// Elementwise arithmetic fused into one pass: a tree of Add, Sub, Mul and Div whose intermediate values
+/// nothing else reads. The value is as long as the shortest input, as if each operation ran on its own.
+/// Operands [0, count) of `code` are the inputs, listed in Chunk::operands from `first`, and the rest are
+/// temporaries, which `dst` names; the last instruction computes the value.
+struct Loop {
+    std::uint32_t      first;
+    std::uint32_t      count;
+    std::vector<Instr> code;
+    std::uint16_t      temps = 0;
+};
+
+/// A flat, register-based form of a program. Every instruction writes a fresh register, so a register
+/// index identifies a single value for the whole run.
+struct Chunk {
+    std::vector<Instr>              code;
+    std::vector<std::vector<float>> constants;
+    std::vector<Call>               calls;
+    std::vector<Loop>               loops;
+    std::vector<std::uint16_t>      operands;
+    std::vector<int>                lengths; // element count of each register, -1 if unknown; set by optimize()
+    std::vector<Source>             sources; // code each register's value was computed from, for profiles
+    std::uint16_t                   registers = 0;
+    std::uint16_t                   result    = 0;
+};
+
+struct Builder {
+    Chunk&                     chunk;
+    std::string                error;
+    std::vector<std::uint16_t> locals; // register last assigned to each local
+    std::vector<std::uint16_t> args;   // registers of the arguments of the definition being inlined
+    /// The outermost definition call being inlined. Its body was parsed from other code, so everything it
+    /// computes is attributed to the call.
+    std::optional<Source> site;
+
+    /// `source` is the node computing the value.
+    std::uint16_t emit(Op op, Source source, std::uint16_t a = 0, std::uint16_t b = 0);
+    std::uint16_t constant(const std::vector<float>& value, Source source);
+    std::uint16_t call(
+        const Function*                   function,
+        Builtin                           builtin,
+        const std::vector<std::uint16_t>& args,
+        std::uint32_t                     offset,
+        Source                            source
+    );
+};
+
+/// Lowers the statements of a program; the value of the last one becomes the chunk's result.
+bool lower(Chunk& chunk, const std::vector<Expr*>& statements, std::string* error);
+
+/// Folds constants, including pure built-in calls, removes identities that cannot change the result
+/// (x * 1, x - 0, max of one element, ...), merges repeated pure computations and drops unused ones.
+/// Calls with side effects (user functions, push, pop) are kept in order. Finally, trees of arithmetic
+/// become Loop instructions. Defined in Optimizer.cpp.
+///
+/// Along the way it infers the length of every value that doesn't depend on user functions or pop, and
+/// records them in Chunk::lengths so arithmetic on short tuples of known length runs unrolled. An
+/// `of` or `subtuple` whose constant index is past the end of a tuple of known length is an error:
+/// returns false and sets `*error` to it and its position in `code`, the source of the chunk.
+bool optimize(Chunk& chunk, std::string_view code, std::string* error);
+
+/// The result lives in the state's scratch arena, the chunk's constants or `slots`.
+std::span<const float> run(const Chunk& chunk, const Slots& slots, EvalContext::State& state);
+/// Same as run(), adding the time and scratch bytes of every operation to profile.operations[dst]. Two
+/// clock reads per operation make it several times slower.
+std::span<const float> run(const Chunk& chunk, const Slots& slots, EvalContext::State& state, Profile& profile);
+} // namespace expr::bytecode
@@ -0,0 +1,136 @@
+#include "Codegen.hpp"
+#include "Scalar.hpp"
+#include "Verify.hpp"
+
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace expr::codegen {
+namespace {
+constexpr const char* slot_names[] = {"ori", "continentalness", "erosion", "weirdness"};
+static_assert(std::size(slot_names) == static_cast<std::size_t>(Slot::Count));
+
+// Exact in C++20: a hexadecimal literal for finite values, the bits for the others.
+std::string literal(float value) {
+    char buffer[48];
+    if (std::isfinite(value)) {
+        std::snprintf(buffer, sizeof(buffer), value < 0 || std::signbit(value) ? "(%af)" : "%af", value);
+    } else {
+        std::snprintf(buffer, sizeof(buffer), "std::bit_cast<float>(0x%08xu)", std::bit_cast<std::uint32_t>(value));
+    }
+    return buffer;
+}
+
+} // namespace
+
+std::uint64_t
+hash(std::string_view factor, std::string_view jaggedness, std::string_view offset, std::string_view definitions) {
+    std::uint64_t h = 14695981039346656037ull;
+    for (auto source : {factor, jaggedness, offset, definitions}) {
+        for (auto c : source) {
+            h ^= static_cast<std::uint8_t>(c);
+            h *= 1099511628211ull;
+        }
+        h *= 1099511628211ull; // the NUL
+    }
+    return h;
+}
+
+std::string emit(const scalar::Chunk& chunk, std::string_view name) {
+    auto signature = std::string(name) + "(float ori, float continentalness, float erosion, float weirdness)";
+    if (chunk.results.empty() || chunk.inputs != static_cast<std::uint16_t>(Slot::Count)) {
+        return "constexpr float " + signature + " {\n    (void)continentalness, (void)erosion, (void)weirdness;\n"
+             + "    return ori;\n}\n";
+    }
+
+    // Only what the first value depends on.
+    std::vector<bool> live(chunk.registers, false);
+    live[chunk.results[0]] = true;
+    for (auto i = chunk.code.size(); i-- > 0;) {
+        auto& instr = chunk.code[i];
+        if (!live[instr.dst]) continue;
+        live[instr.a] = true;
+        if (scalar::reads_b(instr.op)) live[instr.b] = true;
+    }
+
+    auto register_name = [&](std::uint16_t reg) -> std::string {
+        if (reg < chunk.inputs) return slot_names[reg];
+        if (reg < chunk.inputs + chunk.constants.size()) return literal(chunk.constants[reg - chunk.inputs]);
+        return "r" + std::to_string(reg);
+    };
+    auto spline_name = [&](std::uint16_t i) { return std::string(name) + "_spline_" + std::to_string(i); };
+
+    std::string       res, body;
+    bool              constant_expression = true;
+    std::vector<bool> spline_used(chunk.splines.size(), false);
+    for (auto& instr : chunk.code) {
+        if (!live[instr.dst]) continue;
+        auto        a = register_name(instr.a);
+        auto        b = scalar::reads_b(instr.op) ? register_name(instr.b) : std::string();
+        std::string value;
+        switch (instr.op) {
+        case scalar::Op::Add:
+            value = a + " + " + b;
+            break;
+        case scalar::Op::Sub:
+            value = a + " - " + b;
+            break;
+        case scalar::Op::Mul:
+            value = a + " * " + b;
+            break;
+        case scalar::Op::Div:
+            value = a + " / " + b;
+            break;
+        case scalar::Op::Max:
+            value = a + " < " + b + " ? " + b + " : " + a;
+            break;
+        case scalar::Op::Min:
+            value = b + " < " + a + " ? " + b + " : " + a;
+            break;
+        case scalar::Op::Pow:
+            value = "std::pow(" + a + ", " + b + ")";
+            break;
+        case scalar::Op::Abs:
+            value = "std::fabs(" + a + ")";
+            break;
+        case scalar::Op::Sqrt:
+            value = "std::sqrt(" + a + ")";
+            break;
+        case scalar::Op::Exp:
+            value = "std::exp(" + a + ")";
+            break;
+        case scalar::Op::Spline:
+            value                = spline_name(instr.b) + "(" + a + ")";
+            spline_used[instr.b] = true;
+            break;
+        }
+        // Add to Min; the <cmath> functions are not constexpr before C++26.
+        constant_expression = constant_expression && instr.op <= scalar::Op::Min;
+        body += "    const float " + register_name(instr.dst) + " = " + value + ";\n";
+    }
+
+    for (std::uint16_t i = 0; i < chunk.splines.size(); i++) {
+        if (!spline_used[i]) continue;
+        auto& points = chunk.splines[i].points();
+        res += "const expr::Spline " + spline_name(i) + "{std::array<float, " + std::to_string(points.size()) + ">{";
+        for (std::size_t j = 0; j < points.size(); j++) res += (j ? ", " : "") + literal(points[j]);
+        res += "}};\n";
+    }
+    res += (constant_expression ? "constexpr float " : "float ") + signature + " {\n";
+    for (std::uint16_t reg = 0; reg < chunk.inputs; reg++) {
+        if (!live[reg]) res += "    (void)" + register_name(reg) + ";\n";
+    }
+    res += body + "    return " + register_name(chunk.results[0]) + ";\n}\n";
+    return res;
+}
+
+bool matches(const Program& program, Function function) {
+    Slots slots;
+    return verify::sample(1024, slots, [&] {
+        auto expected = program.evalFirst(slots, slots[0]);
+        return verify::same(function(slots[0], slots[1], slots[2], slots[3]), expected);
+    });
+}
+} // namespace expr::codegen
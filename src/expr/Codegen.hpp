@@ -0,0 +1,45 @@
+#pragma once
+#include "Expr.hpp"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace expr::scalar {
+struct Chunk;
+}
+
+namespace expr::codegen {
+/// A formula compiled ahead of time: program.evalFirst({ori, continentalness, erosion, weirdness}, ori).
+using Function = float (*)(float ori, float continentalness, float erosion, float weirdness);
+
+/// The factor, jaggedness and offset formulas of one config.json as climate_codegen compiled them, with the
+/// definitions of its `functions` inlined. A null function is a formula that doesn't run on the float-only
+/// path and is left to the runtime engine.
+struct Formulas {
+    std::uint64_t              hash = 0; // hash() of `sources` and `definitions`; 0 when nothing was generated
+    std::array<Function, 3>    functions{};
+    std::array<const char*, 3> sources{};
+    const char*                definitions = "";
+};
+
+/// Defined by the source file climate_codegen writes. A program that links none defines it empty.
+extern const Formulas generated;
+
+/// FNV-1a over the three sources and the definitions, each followed by a NUL so moving text between them
+/// changes the hash.
+std::uint64_t
+hash(std::string_view factor, std::string_view jaggedness, std::string_view offset, std::string_view definitions);
+
+/// The definition of a C++ function `float name(float ori, float continentalness, float erosion, float
+/// weirdness)` computing the first value of `chunk`, or `ori` if it has none. It is `constexpr` when the
+/// chunk only uses arithmetic, max and min, and calls into the expr library for splines. Constants are
+/// written as hexadecimal floats, so the function computes the same bits as scalar::execute unless the
+/// compiler contracts or reorders float operations.
+std::string emit(const scalar::Chunk& chunk, std::string_view name);
+
+/// Whether `function` returns the same bits as program.evalFirst() on random and special inputs.
+bool matches(const Program& program, Function function);
+} // namespace expr::codegen
@@ -0,0 +1,12 @@
+#pragma once
+
+namespace expr {
+/// Wall time of each stage of the calling thread's last compile(), in nanoseconds, for benchmarks.
+struct CompileTimes {
+    double parse      = 0; // tokenizing and building the syntax tree
+    double lower      = 0; // bytecode generation and optimization
+    double specialize = 0; // float-only chunk and batch plan
+};
+
+const CompileTimes& last_compile_times();
+} // namespace expr
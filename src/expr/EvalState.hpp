@@ -0,0 +1,59 @@
+#pragma once
+#include "Arena.hpp"
+#include "Expr.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace expr {
+struct EvalContext::State {
+    // Intermediate tuples of the tree walker and the bytecode interpreter. Reset before every evaluation,
+    // so a result stays valid until the next one.
+    Arena scratch;
+
+    // push/pop values. Popped entries are kept so their capacity can be reused by the next push.
+    std::vector<std::vector<float>> stack;
+    std::size_t                     depth = 0;
+
+    // Bytecode interpreter registers, tree walker locals and user function arguments; they keep their
+    // capacity between runs.
+    std::vector<std::span<const float>> registers;
+    std::vector<std::span<const float>> locals;
+    std::vector<std::vector<float>>     args;
+
+    // Batch constant and temporary blocks, and the per-operand pointers into them.
+    std::vector<float>        blocks;
+    std::vector<const float*> operands;
+
+    void reset() {
+        scratch.reset();
+        depth = 0;
+    }
+
+    void push(std::span<const float> value) {
+        if (depth == stack.size()) stack.emplace_back();
+        stack[depth++].assign(value.begin(), value.end());
+    }
+    /// Popping an empty stack yields an empty tuple. The value is copied to scratch because a later push
+    /// reuses the entry.
+    std::span<const float> pop() {
+        if (depth == 0) return {};
+        auto& value = stack[--depth];
+        auto  res   = scratch.array<float>(value.size());
+        std::copy(value.begin(), value.end(), res.begin());
+        return res;
+    }
+
+    /// User functions take and return vectors; the result is copied to scratch.
+    std::span<const float> invoke(const Function& function, std::span<const std::span<const float>> values) {
+        args.resize(values.size());
+        for (std::size_t i = 0; i < values.size(); i++) args[i].assign(values[i].begin(), values[i].end());
+        auto result = function(args);
+        auto res    = scratch.array<float>(result.size());
+        std::copy(result.begin(), result.end(), res.begin());
+        return res;
+    }
+};
+} // namespace expr
@@ -0,0 +1,438 @@
+#include "Expr.hpp"
+#include "Ast.hpp"
+#include "Arena.hpp"
+#include "Batch.hpp"
+#include "Builtins.hpp"
+#include "Bytecode.hpp"
+#include "Codegen.hpp"
+#include "CompileTimes.hpp"
+#include "EvalState.hpp"
+#include "Jit.hpp"
+#include "Parser.hpp"
+#include "Scalar.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace expr {
+namespace {
+template <typename F>
+std::span<const float> elementwise(const Frame& frame, const Expr& a, const Expr& b, F f) {
+    auto x   = a.eval(frame);
+    auto y   = b.eval(frame);
+    auto res = frame.state.scratch.array<float>(std::min(x.size(), y.size()));
+    for (std::size_t i = 0; i < res.size(); i++) res[i] = f(x[i], y[i]);
+    return res;
+}
+} // namespace
+
+BinaryOperatorExpr::BinaryOperatorExpr(Expr* a, Expr* b) : a(a), b(b) {}
+BinaryOperatorExpr::~BinaryOperatorExpr() {}
+AddExpr::AddExpr(Expr* a, Expr* b) : BinaryOperatorExpr(a, b) {}
+std::span<const float> AddExpr::eval(const Frame& frame) const {
+    return elementwise(frame, *a, *b, [](float x, float y) { return x + y; });
+}
+AddExpr::~AddExpr() {}
+SubExpr::SubExpr(Expr* a, Expr* b) : BinaryOperatorExpr(a, b) {}
+std::span<const float> SubExpr::eval(const Frame& frame) const {
+    return elementwise(frame, *a, *b, [](float x, float y) { return x - y; });
+}
+SubExpr::~SubExpr() {}
+MulExpr::MulExpr(Expr* a, Expr* b) : BinaryOperatorExpr(a, b) {}
+std::span<const float> MulExpr::eval(const Frame& frame) const {
+    return elementwise(frame, *a, *b, [](float x, float y) { return x * y; });
+}
+MulExpr::~MulExpr() {}
+DivExpr::DivExpr(Expr* a, Expr* b) : BinaryOperatorExpr(a, b) {}
+std::span<const float> DivExpr::eval(const Frame& frame) const {
+    return elementwise(frame, *a, *b, [](float x, float y) { return x / y; });
+}
+DivExpr::~DivExpr() {}
+TupleExpr::TupleExpr(const std::vector<float>& data) : data(data) {}
+std::span<const float> TupleExpr::eval(const Frame&) const { return data; }
+TupleExpr::~TupleExpr() {}
+ParamExpr::ParamExpr(Slot slot) : slot(slot) {}
+std::span<const float> ParamExpr::eval(const Frame& frame) const {
+    return {&frame.slots[static_cast<std::size_t>(slot)], 1};
+}
+ParamExpr::~ParamExpr() {}
+LocalExpr::LocalExpr(std::uint16_t index) : index(index) {}
+std::span<const float> LocalExpr::eval(const Frame& frame) const { return frame.state.locals[index]; }
+LocalExpr::~LocalExpr() {}
+AssignExpr::AssignExpr(std::uint16_t index, Expr* value) : index(index), value(value) {}
+std::span<const float> AssignExpr::eval(const Frame& frame) const {
+    auto res                  = value->eval(frame);
+    frame.state.locals[index] = res;
+    return res;
+}
+AssignExpr::~AssignExpr() {}
+CallExpr::CallExpr(const Function* function, Builtin builtin, std::vector<Expr*> args, std::uint32_t offset)
+: function(function),
+  builtin(builtin),
+  args(std::move(args)),
+  offset(offset) {}
+std::span<const float> CallExpr::eval(const Frame& frame) const {
+    auto values = frame.state.scratch.array<std::span<const float>>(args.size());
+    for (std::size_t i = 0; i < args.size(); i++) values[i] = args[i]->eval(frame);
+    switch (builtin) {
+    case Builtin::Push:
+        if (values.empty()) return {};
+        frame.state.push(values[0]);
+        return values[0];
+    case Builtin::Pop:
+        return frame.state.pop();
+    case Builtin::None:
+        return frame.state.invoke(*function, values);
+    default:
+        return builtins::call(builtin, values, frame.state.scratch);
+    }
+}
+CallExpr::~CallExpr() {}
+ArgExpr::ArgExpr(std::uint16_t index) : index(index) {}
+std::span<const float> ArgExpr::eval(const Frame& frame) const { return frame.args[index]; }
+ArgExpr::~ArgExpr() {}
+InlineExpr::InlineExpr(const Definition* definition, std::vector<Expr*> args)
+: definition(definition),
+  args(std::move(args)) {}
+std::span<const float> InlineExpr::eval(const Frame& frame) const {
+    auto values = frame.state.scratch.array<std::span<const float>>(args.size());
+    for (std::size_t i = 0; i < args.size(); i++) values[i] = args[i]->eval(frame);
+    return definition->body->eval({frame.slots, frame.state, values});
+}
+InlineExpr::~InlineExpr() {}
+
+struct Definitions::Impl {
+    std::string                    code; // the names of the definitions point into it
+    FunctionTable                  functions;
+    Arena                          arena; // owns the bodies
+    std::vector<const Definition*> list;
+
+    Impl(const std::string& code, const FunctionTable& functions) : code(code), functions(functions) {}
+    Impl(const Impl&)            = delete;
+    Impl& operator=(const Impl&) = delete;
+};
+
+struct Program::Impl {
+    std::string                              code; // for annotate()
+    FunctionTable                            functions;
+    std::shared_ptr<const Definitions::Impl> definitions; // the tree walker evaluates their bodies
+    Arena                                    arena;       // owns the syntax tree
+    std::vector<Expr*>                       statements;
+    std::uint16_t                            locals = 0;
+    bytecode::Chunk                          chunk;
+    // Set when every value in `chunk` has a known length and no call has side effects.
+    std::optional<scalar::Chunk> scalar;
+    std::optional<batch::Plan>   batch;
+    Program::Inputs              inputs;
+    bool                         identity = false;
+
+    Impl(const FunctionTable& functions) : functions(functions) {}
+    Impl(const Impl&)            = delete;
+    Impl& operator=(const Impl&) = delete;
+};
+
+struct FusedProgram::Impl {
+    scalar::Chunk            chunk;
+    std::optional<jit::Code> native;
+};
+
+EvalContext::EvalContext() : mState(std::make_unique<State>()) {}
+EvalContext::~EvalContext()                                 = default;
+EvalContext::EvalContext(EvalContext&&) noexcept            = default;
+EvalContext& EvalContext::operator=(EvalContext&&) noexcept = default;
+
+EvalContext& EvalContext::local() {
+    thread_local EvalContext context;
+    return context;
+}
+
+namespace {
+// The tuple interpreters; the result lives in the state's scratch arena until its next reset, or in the
+// program or `slots`.
+std::span<const float>
+evaluate(const Program::Impl& impl, Backend backend, const Slots& slots, EvalContext::State& state) {
+    state.reset();
+    if (backend != Backend::Tree) return bytecode::run(impl.chunk, slots, state);
+    state.locals.resize(impl.locals);
+    Frame                  frame{slots, state};
+    std::span<const float> res;
+    for (auto statement : impl.statements) res = statement->eval(frame);
+    return res;
+}
+} // namespace
+
+std::vector<float> Program::eval(const Slots& slots, EvalContext& context) const {
+    if (mBackend != Backend::Tree && mImpl->scalar) {
+        float registers[scalar::max_registers];
+        scalar::run(*mImpl->scalar, slots, registers);
+        std::vector<float> res;
+        for (auto reg : mImpl->scalar->results) res.push_back(registers[reg]);
+        return res;
+    }
+    auto res = evaluate(*mImpl, mBackend, slots, *context.mState);
+    return {res.begin(), res.end()};
+}
+
+float Program::evalFirst(const Slots& slots, float fallback, EvalContext& context) const {
+    if (mNative) {
+        float res;
+        (*mNative)(slots.data(), &res);
+        return res;
+    }
+    if (mBackend != Backend::Tree && mImpl->scalar) return scalar::run_first(*mImpl->scalar, slots, fallback);
+    auto res = evaluate(*mImpl, mBackend, slots, *context.mState);
+    return res.empty() ? fallback : res[0];
+}
+
+float Program::evalFirst(const Slots& slots, float fallback, Profile& profile, EvalContext& context) const {
+    auto& state = *context.mState;
+    state.reset();
+    auto res = bytecode::run(mImpl->chunk, slots, state, profile);
+    return res.empty() ? fallback : res[0];
+}
+
+void Program::evalBatch(
+    std::span<const float> ori,
+    std::span<const float> continentalness,
+    std::span<const float> erosion,
+    std::span<const float> weirdness,
+    std::span<float>       out,
+    EvalContext&           context
+) const {
+    auto n = std::min({ori.size(), continentalness.size(), erosion.size(), weirdness.size(), out.size()});
+    if (mBackend != Backend::Tree && mImpl->batch) {
+        batch::run(
+            *mImpl->batch,
+            {ori.data(), continentalness.data(), erosion.data(), weirdness.data()},
+            out.data(),
+            n,
+            *context.mState
+        );
+        return;
+    }
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = evalFirst({ori[i], continentalness[i], erosion[i], weirdness[i]}, ori[i], context);
+    }
+}
+
+const Program::Inputs& Program::inputs() const { return mImpl->inputs; }
+
+bool Program::isIdentity() const { return mImpl->identity; }
+
+void Program::setBackend(Backend backend) {
+    mBackend = backend;
+    mNative.reset();
+    // Programs with an empty result return their fallback, which native code doesn't know.
+    if (backend == Backend::Jit && mImpl && mImpl->scalar && !mImpl->scalar->results.empty()) {
+        std::uint16_t result = mImpl->scalar->results[0];
+        if (auto code = jit::compile(*mImpl->scalar, {&result, 1})) {
+            mNative = std::make_shared<const jit::Code>(std::move(*code));
+        }
+    }
+}
+
+std::optional<std::string> Program::generateCpp(std::string_view name) const {
+    if (!mImpl || !mImpl->scalar) return std::nullopt;
+    return codegen::emit(*mImpl->scalar, name);
+}
+
+std::string Program::annotate(const Profile& profile) const {
+    if (profile.evaluations == 0) return "no evaluations profiled\n";
+    auto& chunk = mImpl->chunk;
+    auto& code  = mImpl->code;
+
+    // Operations computed from the same code, such as the body of an inlined call, are reported together.
+    struct Entry {
+        Source             source;
+        Profile::Operation cost;
+    };
+    std::vector<Entry> entries;
+    std::uint64_t      total = 0;
+    for (auto& instr : chunk.code) {
+        if (instr.op == bytecode::Op::Const || instr.op == bytecode::Op::Param) continue;
+        if (instr.dst >= profile.operations.size()) continue;
+        auto& operation = profile.operations[instr.dst];
+        auto  source    = chunk.sources[instr.dst];
+        auto  entry     = std::find_if(entries.begin(), entries.end(), [&](const Entry& e) {
+            return e.source.begin == source.begin && e.source.end == source.end;
+        });
+        if (entry == entries.end()) entry = entries.insert(entries.end(), {source, {}});
+        entry->cost.calls += operation.calls;
+        entry->cost.ns    += operation.ns;
+        entry->cost.bytes += operation.bytes;
+        total             += operation.ns;
+    }
+    // By position, enclosing operations before the ones inside them.
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.source.begin != b.source.begin ? a.source.begin < b.source.begin : a.source.end > b.source.end;
+    });
+
+    auto evaluations = static_cast<double>(profile.evaluations);
+    char buffer[128];
+    std::snprintf(
+        buffer,
+        sizeof(buffer),
+        "%llu evaluations, %.1f ns each\n",
+        static_cast<unsigned long long>(profile.evaluations),
+        static_cast<double>(total) / evaluations
+    );
+    std::string res = buffer;
+    for (std::size_t begin = 0; begin < code.size();) {
+        auto end = std::min(code.find('\n', begin), code.size());
+        res.append(code, begin, end - begin);
+        res += '\n';
+        for (auto& [source, cost] : entries) {
+            if (source.begin < begin || source.begin >= end) continue;
+            // Tabs are kept so the marker lines up with the code above it.
+            for (auto i = begin; i < source.begin; i++) res += code[i] == '\t' ? '\t' : ' ';
+            res += '^';
+            res.append(std::min<std::size_t>(source.end, end) - source.begin - 1, '~');
+            auto ns = static_cast<double>(cost.ns);
+            std::snprintf(
+                buffer,
+                sizeof(buffer),
+                " %.1f ns, %.0f%%",
+                ns / evaluations,
+                total ? 100.0 * ns / static_cast<double>(total) : 0.0
+            );
+            res += buffer;
+            if (auto operations = static_cast<double>(cost.calls) / evaluations; operations != 1) {
+                std::snprintf(buffer, sizeof(buffer), ", %g operations", operations);
+                res += buffer;
+            }
+            if (cost.bytes) {
+                std::snprintf(buffer, sizeof(buffer), ", %.0f B", static_cast<double>(cost.bytes) / evaluations);
+                res += buffer;
+            }
+            res += '\n';
+        }
+        begin = end + 1;
+    }
+    return res;
+}
+
+void Profile::add(const Profile& other) {
+    evaluations += other.evaluations;
+    if (operations.size() < other.operations.size()) operations.resize(other.operations.size());
+    for (std::size_t i = 0; i < other.operations.size(); i++) {
+        operations[i].calls += other.operations[i].calls;
+        operations[i].ns    += other.operations[i].ns;
+        operations[i].bytes += other.operations[i].bytes;
+    }
+}
+
+namespace {
+thread_local CompileTimes compile_times;
+
+// Optimizing has removed every computation the value doesn't depend on, except calls with side effects,
+// so the parameters left are the ones that matter. Only the float-only form knows the value's length.
+void analyze(Program::Impl& impl) {
+    for (auto& instr : impl.chunk.code) {
+        if (instr.op == bytecode::Op::Param) impl.inputs.slots[instr.a] = true;
+    }
+    auto&          scalar = impl.scalar;
+    constexpr auto ori    = static_cast<std::uint16_t>(Slot::Ori);
+    impl.inputs.fallback  = !scalar || scalar->results.empty();
+    impl.identity         = scalar && (scalar->results.empty() || scalar->results[0] == ori);
+}
+
+double elapsed(std::chrono::steady_clock::time_point& since) {
+    auto now = std::chrono::steady_clock::now();
+    auto res = std::chrono::duration<double, std::nano>(now - since).count();
+    since    = now;
+    return res;
+}
+} // namespace
+
+const CompileTimes& last_compile_times() { return compile_times; }
+
+std::size_t Definitions::size() const { return mImpl ? mImpl->list.size() : 0; }
+
+std::optional<Definitions> define(const std::string& code, const FunctionTable& functions, std::string* error) {
+    auto impl = std::make_shared<Definitions::Impl>(code, functions);
+    auto list = parser::parse_definitions(impl->code, impl->functions, impl->arena, error);
+    if (!list) return std::nullopt;
+    impl->list = std::move(*list);
+    Definitions res;
+    res.mImpl = std::move(impl);
+    return res;
+}
+
+std::optional<Program>
+compile(const std::string& code, const FunctionTable& functions, std::string* error, const Definitions& definitions) {
+    compile_times     = {};
+    auto clock        = std::chrono::steady_clock::now();
+    auto impl         = std::make_shared<Program::Impl>(functions);
+    impl->code        = code;
+    impl->definitions = definitions.mImpl;
+    std::span<const Definition* const> list;
+    if (impl->definitions) list = impl->definitions->list;
+    auto parsed         = parser::parse(code, impl->functions, list, impl->arena, error);
+    compile_times.parse = elapsed(clock);
+    if (!parsed) return std::nullopt;
+    impl->statements = std::move(parsed->statements);
+    impl->locals     = parsed->locals;
+    if (!bytecode::lower(impl->chunk, impl->statements, error)) return std::nullopt;
+    if (!bytecode::optimize(impl->chunk, code, error)) return std::nullopt;
+    compile_times.lower = elapsed(clock);
+    impl->scalar        = scalar::specialize(impl->chunk);
+    if (impl->scalar) impl->batch = batch::plan(*impl->scalar);
+    compile_times.specialize = elapsed(clock);
+    analyze(*impl);
+    Program program;
+    program.mImpl = std::move(impl);
+    return program;
+}
+
+std::optional<FusedProgram> fuse(std::span<const Program> programs) {
+    std::vector<const scalar::Chunk*> chunks;
+    for (auto& program : programs) {
+        if (!program || program.mBackend == Backend::Tree || !program.mImpl->scalar) return std::nullopt;
+        chunks.push_back(&*program.mImpl->scalar);
+    }
+    auto chunk = scalar::fuse(chunks);
+    if (!chunk) return std::nullopt;
+    auto impl = std::make_shared<FusedProgram::Impl>(FusedProgram::Impl{std::move(*chunk), std::nullopt});
+    if (std::all_of(programs.begin(), programs.end(), [](const Program& program) { return program.isNative(); })) {
+        impl->native = jit::compile(impl->chunk, impl->chunk.results);
+    }
+    FusedProgram res;
+    res.mImpl = std::move(impl);
+    return res;
+}
+
+void FusedProgram::evalFirst(
+    std::span<const float> ori,
+    float                  continentalness,
+    float                  erosion,
+    float                  weirdness,
+    std::span<float>       out
+) const {
+    auto& chunk = mImpl->chunk;
+    float registers[scalar::max_registers];
+    registers[static_cast<std::size_t>(Slot::Ori)]             = ori[0];
+    registers[static_cast<std::size_t>(Slot::Continentalness)] = continentalness;
+    registers[static_cast<std::size_t>(Slot::Erosion)]         = erosion;
+    registers[static_cast<std::size_t>(Slot::Weirdness)]       = weirdness;
+    // The `ori` of every later program follows the shared slots.
+    for (std::size_t i = 1; i < chunk.results.size(); i++) {
+        registers[static_cast<std::size_t>(Slot::Count) + i - 1] = ori[i];
+    }
+    if (mImpl->native) {
+        (*mImpl->native)(registers, out.data());
+        return;
+    }
+    scalar::execute(chunk, registers);
+    for (std::size_t i = 0; i < chunk.results.size(); i++) out[i] = registers[chunk.results[i]];
+}
+
+std::size_t FusedProgram::size() const { return mImpl->chunk.results.size(); }
+} // namespace expr
@@ -0,0 +1,227 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace expr {
+namespace jit {
+class Code;
+}
+
+using Function      = std::function<std::vector<float>(const std::vector<std::vector<float>>&)>;
+using FunctionTable = std::unordered_map<std::string, Function>;
+
+/// Parameter layout shared by every program. Names are resolved to these indices by compile().
+enum class Slot : std::size_t { Ori, Continentalness, Erosion, Weirdness, Count };
+using Slots = std::array<float, static_cast<std::size_t>(Slot::Count)>;
+
+/// How a compiled program is executed. All backends produce identical results.
+enum class Backend {
+    Tree,     // walks the syntax tree, one virtual call per node
+    Bytecode, // runs a flat register-based instruction array
+    Jit,      // native x86-64 code for float-only programs, Bytecode for everything else
+};
+
+/// Scratch state for evaluation: the push/pop stack and the interpreters' buffers. Buffers keep their
+/// capacity, so a context that has been used once evaluates the same program again without allocating.
+/// A context may serve any number of programs, but only one thread at a time.
+class EvalContext {
+public:
+    EvalContext();
+    ~EvalContext();
+    EvalContext(EvalContext&&) noexcept;
+    EvalContext& operator=(EvalContext&&) noexcept;
+
+    /// The calling thread's context, used by the Program overloads that don't take one.
+    static EvalContext& local();
+
+    struct State;
+
+private:
+    friend class Program;
+
+    std::unique_ptr<State> mState;
+};
+
+class FusedProgram;
+class Definitions;
+
+/// Where the time of the evaluations profiled with it went in one program: see the evalFirst() overload
+/// taking a Profile. A profile records on one thread; add() merges those of other threads.
+struct Profile {
+    struct Operation {
+        std::uint64_t calls = 0;
+        std::uint64_t ns    = 0;
+        std::uint64_t bytes = 0; // of intermediate tuples
+    };
+    std::uint64_t          evaluations = 0;
+    std::vector<Operation> operations; // by the program's bytecode register, sized when first used
+
+    /// `other` must have been recorded with the same program.
+    void add(const Profile& other);
+};
+
+class Program {
+public:
+    Program() = default;
+
+    /// Evaluates every statement in order and returns the value of the last one.
+    [[nodiscard]] std::vector<float> eval(const Slots& slots, EvalContext& context) const;
+    /// Same as eval(slots)[0], or `fallback` if the result is empty. Programs whose values all have a
+    /// length known at compile time run on a float-only path here that never allocates.
+    [[nodiscard]] float evalFirst(const Slots& slots, float fallback, EvalContext& context) const;
+    /// Same as evalFirst(), adding the time, calls and scratch allocations of every operation to `profile`.
+    /// Whatever the backend, the program runs on the bytecode interpreter with two clock reads around
+    /// each operation, so the costs say which parts of the formula are expensive rather than how long the
+    /// JIT takes. Meant for a sample of the evaluations.
+    [[nodiscard]] float evalFirst(const Slots& slots, float fallback, Profile& profile, EvalContext& context) const;
+    /// Evaluates many samples given as one array per slot: out[i] = evalFirst(slots of sample i, ori[i]).
+    /// Fixed-length programs run block by block on SIMD kernels; others fall back to one call per sample.
+    /// The number of samples is the shortest of the five spans.
+    void evalBatch(
+        std::span<const float> ori,
+        std::span<const float> continentalness,
+        std::span<const float> erosion,
+        std::span<const float> weirdness,
+        std::span<float>       out,
+        EvalContext&           context
+    ) const;
+
+    [[nodiscard]] std::vector<float> eval(const Slots& slots) const { return eval(slots, EvalContext::local()); }
+    [[nodiscard]] float              evalFirst(const Slots& slots, float fallback) const {
+        return evalFirst(slots, fallback, EvalContext::local());
+    }
+    void evalBatch(
+        std::span<const float> ori,
+        std::span<const float> continentalness,
+        std::span<const float> erosion,
+        std::span<const float> weirdness,
+        std::span<float>       out
+    ) const {
+        evalBatch(ori, continentalness, erosion, weirdness, out, EvalContext::local());
+    }
+
+    /// What evalFirst() can depend on, found by analysing the optimized program when it is compiled.
+    struct Inputs {
+        std::array<bool, static_cast<std::size_t>(Slot::Count)> slots{}; // read by some evaluation
+        bool fallback = false; // the value may be empty, in which case evalFirst() returns its fallback
+    };
+    [[nodiscard]] const Inputs& inputs() const;
+    /// Whether evalFirst(slots, slots[Ori]) always returns slots[Ori]: the optimized program is `ori;` or
+    /// has an empty value, and has no side effects.
+    [[nodiscard]] bool isIdentity() const;
+
+    [[nodiscard]] Backend getBackend() const { return mBackend; }
+    /// Selecting Backend::Jit compiles native code for the program if it can; see isNative().
+    void setBackend(Backend backend);
+    /// Whether evalFirst() runs native code.
+    [[nodiscard]] bool isNative() const { return mNative != nullptr; }
+    /// C++ source of a function `name` computing evalFirst(slots, slots[Ori]) from the four slots, for
+    /// compiling the formula ahead of time; see codegen::emit(). std::nullopt unless the program runs on
+    /// the float-only path.
+    [[nodiscard]] std::optional<std::string> generateCpp(std::string_view name) const;
+    /// The source with every operation of `profile` marked under it, and its time per evaluation, share of
+    /// the total, operations and bytes allocated. The body of an inlined definition counts toward its call.
+    [[nodiscard]] std::string annotate(const Profile& profile) const;
+
+    [[nodiscard]] explicit operator bool() const { return mImpl != nullptr; }
+
+    struct Impl;
+
+private:
+    friend std::optional<Program> compile(
+        const std::string&   code,
+        const FunctionTable& functions,
+        std::string*         error,
+        const Definitions&   definitions
+    );
+    friend std::optional<FusedProgram> fuse(std::span<const Program> programs);
+
+    std::shared_ptr<const Impl>      mImpl;
+    std::shared_ptr<const jit::Code> mNative; // set while the backend is Jit and the program compiled
+    Backend                          mBackend = Backend::Bytecode;
+};
+
+/// Programs that share continentalness, erosion and weirdness but each read their own `ori`, merged into
+/// one pass in which the values they have in common are computed once.
+class FusedProgram {
+public:
+    FusedProgram() = default;
+
+    /// out[i] = programs[i].evalFirst({ori[i], continentalness, erosion, weirdness}, ori[i]) for the
+    /// programs passed to fuse(). Never allocates.
+    void evalFirst(
+        std::span<const float> ori,
+        float                  continentalness,
+        float                  erosion,
+        float                  weirdness,
+        std::span<float>       out
+    ) const;
+
+    /// Number of programs fused.
+    [[nodiscard]] std::size_t size() const;
+
+    [[nodiscard]] explicit operator bool() const { return mImpl != nullptr; }
+
+    struct Impl;
+
+private:
+    friend std::optional<FusedProgram> fuse(std::span<const Program> programs);
+
+    std::shared_ptr<const Impl> mImpl;
+};
+
+/// Functions written in the formula language, such as `ramp(x, a, b) = clamp((x - a) / (b - a), 0, 1);`,
+/// parsed once and shared by the programs compiled with them. Calls to them are inlined, so they cost
+/// nothing at run time and the optimizer folds and fuses across them.
+class Definitions {
+public:
+    Definitions() = default;
+
+    /// Number of functions defined.
+    [[nodiscard]] std::size_t size() const;
+
+    struct Impl;
+
+private:
+    friend std::optional<Definitions>
+    define(const std::string& code, const FunctionTable& functions, std::string* error);
+    friend std::optional<Program> compile(
+        const std::string&   code,
+        const FunctionTable& functions,
+        std::string*         error,
+        const Definitions&   definitions
+    );
+
+    std::shared_ptr<const Impl> mImpl;
+};
+
+/// Parses definitions `name(params) = body;`. A body is a single expression that reads its parameters by
+/// name and may use the four slots, built-ins, `functions` and the definitions before it. On failure
+/// returns std::nullopt and, if `error` is given, stores a description of the problem in it.
+[[nodiscard]] std::optional<Definitions>
+define(const std::string& code, const FunctionTable& functions = {}, std::string* error = nullptr);
+
+/// Parses `code` once and resolves parameters and functions, so the result can be evaluated repeatedly.
+/// Calls to `definitions` are inlined; they shadow `functions` and built-ins of the same name. On failure
+/// returns std::nullopt and, if `error` is given, stores a description of the problem in it.
+[[nodiscard]] std::optional<Program> compile(
+    const std::string&   code,
+    const FunctionTable& functions   = {},
+    std::string*         error       = nullptr,
+    const Definitions&   definitions = {}
+);
+
+/// Fuses programs that run on the float-only path with the bytecode or JIT backend; returns std::nullopt
+/// if any of them doesn't or the merged program would be too large. The result runs native code if every
+/// program does.
+[[nodiscard]] std::optional<FusedProgram> fuse(std::span<const Program> programs);
+} // namespace expr
@@ -0,0 +1,394 @@
+#include "Jit.hpp"
+#include "Verify.hpp"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define EXPR_JIT_X64 1
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+namespace expr::jit {
+namespace {
+#ifdef EXPR_JIT_X64
+// Executable memory is mapped writable, filled, then flipped to read+execute so it is never both.
+void* allocate(std::size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? nullptr : memory;
+#endif
+}
+bool protect(void* memory, std::size_t size) {
+#ifdef _WIN32
+    DWORD old;
+    return VirtualProtect(memory, size, PAGE_EXECUTE_READ, &old)
+        && FlushInstructionCache(GetCurrentProcess(), memory, size);
+#else
+    return mprotect(memory, size, PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+#ifdef _WIN32
+static_assert(sizeof(RUNTIME_FUNCTION) == 12);
+// The function table Assembler::unwind_info() appended to the code.
+RUNTIME_FUNCTION* function_table(void* memory, std::size_t size) {
+    return reinterpret_cast<RUNTIME_FUNCTION*>(static_cast<std::uint8_t*>(memory) + size - sizeof(RUNTIME_FUNCTION));
+}
+#endif
+bool register_unwind([[maybe_unused]] void* memory, [[maybe_unused]] std::size_t size) {
+#ifdef _WIN32
+    return RtlAddFunctionTable(function_table(memory, size), 1, reinterpret_cast<DWORD64>(memory)) != FALSE;
+#else
+    return true; // nothing the code calls throws, and nothing else needs unwind information on System V
+#endif
+}
+void release(void* memory, [[maybe_unused]] std::size_t size) {
+#ifdef _WIN32
+    RtlDeleteFunctionTable(function_table(memory, size)); // fails harmlessly if it was never registered
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, size);
+#endif
+}
+
+// General purpose register numbers as used in ModRM.
+enum Reg : std::uint8_t { Rax = 0, Rcx = 1, Rdx = 2, Rsp = 4, Rsi = 6, Rdi = 7 };
+#ifdef _WIN32
+constexpr Reg input_base  = Rcx;
+constexpr Reg output_base = Rdx;
+constexpr Reg second_int  = Rdx; // integer argument after a float one
+#else
+constexpr Reg input_base  = Rdi;
+constexpr Reg output_base = Rsi;
+constexpr Reg second_int  = Rdi;
+#endif
+
+// Scalar SSE opcodes after the F3 0F prefix.
+enum Sse : std::uint8_t {
+    Load  = 0x10, // movss xmm, m32
+    Store = 0x11, // movss m32, xmm
+    Add   = 0x58,
+    Mul   = 0x59,
+    Sub   = 0x5c,
+    Min   = 0x5d,
+    Div   = 0x5e,
+    Max   = 0x5f,
+    Sqrt  = 0x51,
+};
+
+// What the generated code calls for the ops without an instruction. They go through the same C library
+// functions as scalar::execute, so the results match.
+float call_pow(float a, float b) { return std::pow(a, b); }
+float call_exp(float a) { return std::exp(a); }
+float call_spline(float a, const Spline* spline) { return (*spline)(a); }
+
+bool calls(scalar::Op op) { return op == scalar::Op::Pow || op == scalar::Op::Exp || op == scalar::Op::Spline; }
+
+// Every value lives in memory: inputs behind the first argument, constants after the code (addressed
+// relative to rip) and temporaries in a stack frame. xmm0 is the only register used, and remembers the
+// last value loaded or stored so a chain of operations doesn't reload it.
+//
+// Code that calls out reserves the callee's shadow space at the bottom of the frame and keeps the two base
+// pointers above it, reloading them after every call; the frame is sized to leave rsp 16-byte aligned.
+struct Assembler {
+    const scalar::Chunk&       chunk;
+    const Spline*              splines; // the copies Code keeps
+    std::vector<std::uint8_t>  code;
+    std::vector<std::uint32_t> fixups; // offsets of rip-relative displacements, paired with constant indices
+    std::vector<std::uint16_t> constants;
+    int                        cached      = -1;
+    std::uint32_t              temp_offset = 0;
+
+    static constexpr std::uint32_t saved_bases = 32; // after the shadow space
+
+    void byte(std::uint8_t b) { code.push_back(b); }
+    void dword(std::uint32_t v) {
+        for (int i = 0; i < 4; i++) byte(static_cast<std::uint8_t>(v >> (8 * i)));
+    }
+    void qword(std::uint64_t v) {
+        dword(static_cast<std::uint32_t>(v));
+        dword(static_cast<std::uint32_t>(v >> 32));
+    }
+
+    // xmm `xmm` with a [base + disp32] operand.
+    void memory(std::uint8_t op, Reg base, std::uint32_t disp, std::uint8_t xmm = 0) {
+        byte(0xf3);
+        byte(0x0f);
+        byte(op);
+        byte(static_cast<std::uint8_t>(0x80 | xmm << 3 | base));
+        if (base == Rsp) byte(0x24);
+        dword(disp);
+    }
+    // xmm `xmm` with the operand holding chunk register `reg`.
+    void operand(std::uint8_t op, std::uint16_t reg, std::uint8_t xmm = 0) {
+        auto constant_base = chunk.inputs;
+        auto temp_base     = static_cast<std::size_t>(chunk.inputs + chunk.constants.size());
+        if (reg < constant_base) {
+            memory(op, input_base, 4u * reg, xmm);
+        } else if (reg < temp_base) {
+            byte(0xf3);
+            byte(0x0f);
+            byte(op);
+            byte(static_cast<std::uint8_t>(0x05 | xmm << 3)); // [rip + disp32]
+            fixups.push_back(static_cast<std::uint32_t>(code.size()));
+            constants.push_back(static_cast<std::uint16_t>(reg - constant_base));
+            dword(0);
+        } else {
+            memory(op, Rsp, temp_offset + static_cast<std::uint32_t>(4 * (reg - temp_base)), xmm);
+        }
+    }
+    // mov [rsp + disp32], reg (0x89) or mov reg, [rsp + disp32] (0x8b), 64-bit.
+    void stack(std::uint8_t op, Reg reg, std::uint32_t disp) {
+        byte(0x48);
+        byte(op);
+        byte(static_cast<std::uint8_t>(0x84 | reg << 3));
+        byte(0x24);
+        dword(disp);
+    }
+    // mov reg, imm64
+    void immediate(Reg reg, std::uint64_t value) {
+        byte(0x48);
+        byte(static_cast<std::uint8_t>(0xb8 + reg));
+        qword(value);
+    }
+    // Calls `function` with the arguments already in place, then restores the bases it may have clobbered.
+    void call(const void* function) {
+        immediate(Rax, reinterpret_cast<std::uintptr_t>(function));
+        byte(0xff); // call rax
+        byte(0xd0);
+        stack(0x8b, input_base, saved_bases);
+        stack(0x8b, output_base, saved_bases + 8);
+    }
+    void load(std::uint16_t reg) {
+        if (cached == reg) return;
+        operand(Load, reg);
+        cached = reg;
+    }
+    void frame(std::uint8_t op, std::uint32_t size) {
+        if (size == 0) return;
+        byte(0x48);
+        byte(0x81);
+        byte(op);
+        dword(size);
+    }
+
+    void instr(const scalar::Instr& instr) {
+        // maxss/minss keep the destination only if the comparison holds, so loading b first gives
+        // exactly `a < b ? b : a` and `b < a ? b : a`.
+        switch (instr.op) {
+        case scalar::Op::Add:
+            load(instr.a);
+            operand(Add, instr.b);
+            break;
+        case scalar::Op::Sub:
+            load(instr.a);
+            operand(Sub, instr.b);
+            break;
+        case scalar::Op::Mul:
+            load(instr.a);
+            operand(Mul, instr.b);
+            break;
+        case scalar::Op::Div:
+            load(instr.a);
+            operand(Div, instr.b);
+            break;
+        case scalar::Op::Max:
+            load(instr.b);
+            operand(Max, instr.a);
+            break;
+        case scalar::Op::Min:
+            load(instr.b);
+            operand(Min, instr.a);
+            break;
+        case scalar::Op::Sqrt:
+            operand(Sqrt, instr.a);
+            break;
+        case scalar::Op::Abs:
+            load(instr.a);
+            byte(0x66); // movd eax, xmm0
+            byte(0x0f);
+            byte(0x7e);
+            byte(0xc0);
+            byte(0x25); // and eax, imm32
+            dword(0x7fffffff);
+            byte(0x66); // movd xmm0, eax
+            byte(0x0f);
+            byte(0x6e);
+            byte(0xc0);
+            break;
+        case scalar::Op::Pow:
+            load(instr.a);
+            operand(Load, instr.b, 1);
+            call(reinterpret_cast<const void*>(&call_pow));
+            break;
+        case scalar::Op::Exp:
+            load(instr.a);
+            call(reinterpret_cast<const void*>(&call_exp));
+            break;
+        case scalar::Op::Spline:
+            load(instr.a);
+            immediate(second_int, reinterpret_cast<std::uintptr_t>(splines + instr.b));
+            call(reinterpret_cast<const void*>(&call_spline));
+            break;
+        }
+        operand(Store, instr.dst);
+        cached = instr.dst;
+    }
+
+    void assemble(std::span<const std::uint16_t> outputs) {
+        // Only instructions some output depends on are emitted.
+        std::vector<bool> live(chunk.registers, false);
+        for (auto reg : outputs) live[reg] = true;
+        bool              calling = false;
+        for (auto i = chunk.code.size(); i-- > 0;) {
+            auto& instr = chunk.code[i];
+            if (!live[instr.dst]) continue;
+            live[instr.a] = true;
+            if (scalar::reads_b(instr.op)) live[instr.b] = true;
+            calling = calling || calls(instr.op);
+        }
+        auto temps      = chunk.registers - chunk.inputs - chunk.constants.size();
+        auto frame_size = static_cast<std::uint32_t>((4 * temps + 15) & ~std::size_t{15});
+        if (calling) {
+            // The return address leaves rsp 8 bytes off alignment on entry.
+            temp_offset  = saved_bases + 16;
+            frame_size  += temp_offset + 8;
+        }
+        frame(0xec, frame_size); // sub rsp, imm32
+        if (calling) {
+            stack(0x89, input_base, saved_bases);
+            stack(0x89, output_base, saved_bases + 8);
+        }
+        for (auto& instr : chunk.code) {
+            if (live[instr.dst]) this->instr(instr);
+        }
+        for (std::size_t i = 0; i < outputs.size(); i++) {
+            load(outputs[i]);
+            memory(Store, output_base, static_cast<std::uint32_t>(4 * i));
+        }
+        frame(0xc4, frame_size); // add rsp, imm32
+        byte(0xc3);              // ret
+        [[maybe_unused]] auto end = static_cast<std::uint32_t>(code.size());
+
+        while (code.size() % 4) byte(0xcc);
+        auto pool = code.size();
+        for (auto v : chunk.constants) dword(std::bit_cast<std::uint32_t>(v));
+        for (std::size_t i = 0; i < fixups.size(); i++) {
+            auto target = pool + 4 * constants[i];
+            auto disp   = static_cast<std::int32_t>(target - (fixups[i] + 4));
+            std::memcpy(code.data() + fixups[i], &disp, sizeof(disp));
+        }
+#ifdef _WIN32
+        unwind_info(end, frame_size);
+#endif
+    }
+
+#ifdef _WIN32
+    // The UNWIND_INFO and RUNTIME_FUNCTION a compiler would put in .xdata and .pdata, so exceptions, debuggers
+    // and profilers can walk the stack through the code while pow, exp or a spline runs. The only prologue
+    // instruction is the 7-byte `sub rsp, frame_size`, and the epilogue is the `add rsp`/`ret` form the
+    // unwinder recognizes. The RUNTIME_FUNCTION goes last, where register_unwind() and release() find it.
+    void unwind_info(std::uint32_t end, std::uint32_t frame_size) {
+        while (code.size() % 4) byte(0);
+        auto info = static_cast<std::uint32_t>(code.size());
+        byte(1);                  // version 1, no flags
+        byte(frame_size ? 7 : 0); // prologue size
+        byte(frame_size ? 3 : 0); // unwind code slots
+        byte(0);                  // no frame register
+        if (frame_size) {
+            byte(7);    // the allocation ends the prologue
+            byte(0x11); // UWOP_ALLOC_LARGE with the size unscaled in the next two slots
+            dword(frame_size);
+            for (int i = 0; i < 2; i++) byte(0); // the slots are padded to an even count
+        }
+        dword(0); // BeginAddress
+        dword(end);
+        dword(info);
+    }
+#endif
+};
+
+bool verify(const Code& code, const scalar::Chunk& chunk, std::span<const std::uint16_t> outputs) {
+    float              registers[scalar::max_registers];
+    std::vector<float> native(outputs.size());
+    return verify::sample(256, std::span(registers, chunk.inputs), [&] {
+        code(registers, native.data());
+        scalar::execute(chunk, registers);
+        for (std::size_t i = 0; i < outputs.size(); i++) {
+            if (!verify::same(native[i], registers[outputs[i]])) return false;
+        }
+        return true;
+    });
+}
+#endif
+} // namespace
+
+Code::Code(void* memory, std::size_t size, std::vector<Spline> splines)
+: mMemory(memory),
+  mSize(size),
+  mFunction(reinterpret_cast<Function>(memory)),
+  mSplines(std::move(splines)) {}
+Code::Code(Code&& other) noexcept
+: mMemory(std::exchange(other.mMemory, nullptr)),
+  mSize(std::exchange(other.mSize, 0)),
+  mFunction(std::exchange(other.mFunction, nullptr)),
+  mSplines(std::move(other.mSplines)) {}
+Code& Code::operator=(Code&& other) noexcept {
+    std::swap(mMemory, other.mMemory);
+    std::swap(mSize, other.mSize);
+    std::swap(mFunction, other.mFunction);
+    std::swap(mSplines, other.mSplines);
+    return *this;
+}
+Code::~Code() {
+#ifdef EXPR_JIT_X64
+    if (mMemory) release(mMemory, mSize);
+#endif
+}
+
+bool supported() {
+#ifdef EXPR_JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::optional<Code> compile(
+    [[maybe_unused]] const scalar::Chunk&           chunk,
+    [[maybe_unused]] std::span<const std::uint16_t> outputs
+) {
+#ifdef EXPR_JIT_X64
+    // Moving a vector keeps its elements where they are, so the addresses baked into the code stay valid.
+    auto      splines = chunk.splines;
+    Assembler assembler{chunk, splines.data(), {}, {}, {}};
+    assembler.assemble(outputs);
+    auto& bytes  = assembler.code;
+    auto  memory = allocate(bytes.size());
+    if (!memory) return std::nullopt;
+    std::memcpy(memory, bytes.data(), bytes.size());
+    Code code(memory, bytes.size(), std::move(splines));
+    if (!protect(memory, bytes.size()) || !register_unwind(memory, bytes.size()) || !verify(code, chunk, outputs)) {
+        return std::nullopt;
+    }
+    return code;
+#else
+    return std::nullopt;
+#endif
+}
+} // namespace expr::jit
@@ -0,0 +1,44 @@
+#pragma once
+#include "Scalar.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace expr::jit {
+/// Native code for a scalar::Chunk, in memory the process owns and frees with it.
+class Code {
+public:
+    /// Reads the chunk's inputs from `inputs` and stores the requested results to `outputs`.
+    using Function = void (*)(const float* inputs, float* outputs);
+
+    Code(const Code&)            = delete;
+    Code& operator=(const Code&) = delete;
+    Code(Code&& other) noexcept;
+    Code& operator=(Code&& other) noexcept;
+    ~Code();
+
+    void operator()(const float* inputs, float* outputs) const { mFunction(inputs, outputs); }
+
+private:
+    friend std::optional<Code> compile(const scalar::Chunk& chunk, std::span<const std::uint16_t> outputs);
+
+    Code(void* memory, std::size_t size, std::vector<Spline> splines);
+
+    void*               mMemory   = nullptr;
+    std::size_t         mSize     = 0;
+    Function            mFunction = nullptr;
+    std::vector<Spline> mSplines; // the code holds pointers to these
+};
+
+/// Whether compile() can produce code on this platform (x86-64 Windows or System V).
+bool supported();
+
+/// Compiles `chunk` so that outputs[i] receives register outputs[i]. The code is checked against
+/// scalar::execute on random and special inputs before it is returned; std::nullopt means the
+/// platform isn't supported, executable memory couldn't be obtained or registered for unwinding, or the
+/// check failed.
+std::optional<Code> compile(const scalar::Chunk& chunk, std::span<const std::uint16_t> outputs);
+} // namespace expr::jit
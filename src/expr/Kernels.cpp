@@ -0,0 +1,206 @@
+#include "Kernels.hpp"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define EXPR_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define EXPR_TARGET_AVX2
+#else
+#define EXPR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace expr::kernels {
+namespace {
+// Portable versions for targets without SSE.
+struct AddOp {
+    static float apply(float a, float b) { return a + b; }
+};
+struct SubOp {
+    static float apply(float a, float b) { return a - b; }
+};
+struct MulOp {
+    static float apply(float a, float b) { return a * b; }
+};
+struct DivOp {
+    static float apply(float a, float b) { return a / b; }
+};
+struct MaxOp {
+    static float apply(float a, float b) { return a < b ? b : a; }
+};
+struct MinOp {
+    static float apply(float a, float b) { return b < a ? b : a; }
+};
+
+struct AbsOp {
+    static float apply(float a) { return std::fabs(a); }
+};
+struct SqrtOp {
+    static float apply(float a) { return std::sqrt(a); }
+};
+
+template <typename Op>
+void generic(const float* a, const float* b, float* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) dst[i] = Op::apply(a[i], b[i]);
+}
+
+template <typename Op>
+void generic(const float* a, float* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) dst[i] = Op::apply(a[i]);
+}
+
+// exp and pow stay on the C library everywhere: a vector approximation would round differently from the
+// scalar backends.
+void pow(const float* a, const float* b, float* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) dst[i] = std::pow(a[i], b[i]);
+}
+void exp(const float* a, float* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) dst[i] = std::exp(a[i]);
+}
+
+#ifdef EXPR_KERNELS_X86
+// MAXPS/MINPS return their second operand when the comparison fails (NaN included), so swapping the
+// operands gives exactly `a < b ? b : a` and `b < a ? b : a`.
+#define EXPR_SSE_KERNEL(name, expr)                                                                                    \
+    void name(const float* a, const float* b, float* dst, std::size_t n) {                                             \
+        std::size_t i = 0;                                                                                             \
+        for (; i + 4 <= n; i += 4) {                                                                                   \
+            auto x = _mm_loadu_ps(a + i);                                                                              \
+            auto y = _mm_loadu_ps(b + i);                                                                              \
+            _mm_storeu_ps(dst + i, expr);                                                                              \
+        }                                                                                                              \
+        for (; i < n; i++) {                                                                                           \
+            auto x = _mm_load_ss(a + i);                                                                               \
+            auto y = _mm_load_ss(b + i);                                                                               \
+            _mm_store_ss(dst + i, expr);                                                                               \
+        }                                                                                                              \
+    }
+EXPR_SSE_KERNEL(sse_add, _mm_add_ps(x, y))
+EXPR_SSE_KERNEL(sse_sub, _mm_sub_ps(x, y))
+EXPR_SSE_KERNEL(sse_mul, _mm_mul_ps(x, y))
+EXPR_SSE_KERNEL(sse_div, _mm_div_ps(x, y))
+EXPR_SSE_KERNEL(sse_max, _mm_max_ps(y, x))
+EXPR_SSE_KERNEL(sse_min, _mm_min_ps(y, x))
+#undef EXPR_SSE_KERNEL
+
+// SQRTPS is correctly rounded like std::sqrt, and clearing the sign bit is what std::fabs does.
+#define EXPR_SSE_UNARY_KERNEL(name, expr)                                                                              \
+    void name(const float* a, float* dst, std::size_t n) {                                                             \
+        std::size_t i = 0;                                                                                             \
+        for (; i + 4 <= n; i += 4) {                                                                                   \
+            auto x = _mm_loadu_ps(a + i);                                                                              \
+            _mm_storeu_ps(dst + i, expr);                                                                              \
+        }                                                                                                              \
+        for (; i < n; i++) {                                                                                           \
+            auto x = _mm_load_ss(a + i);                                                                               \
+            _mm_store_ss(dst + i, expr);                                                                               \
+        }                                                                                                              \
+    }
+EXPR_SSE_UNARY_KERNEL(sse_abs, _mm_andnot_ps(_mm_set1_ps(-0.0f), x))
+EXPR_SSE_UNARY_KERNEL(sse_sqrt, _mm_sqrt_ps(x))
+#undef EXPR_SSE_UNARY_KERNEL
+
+// The rest of the program is built without AVX, so the upper register halves are cleared before handing
+// back to SSE code; leaving them dirty slows down every later SSE instruction on some CPUs.
+#define EXPR_AVX2_KERNEL(name, expr, tail)                                                                             \
+    EXPR_TARGET_AVX2 void name(const float* a, const float* b, float* dst, std::size_t n) {                            \
+        std::size_t i = 0;                                                                                             \
+        for (; i + 8 <= n; i += 8) {                                                                                   \
+            auto x = _mm256_loadu_ps(a + i);                                                                           \
+            auto y = _mm256_loadu_ps(b + i);                                                                           \
+            _mm256_storeu_ps(dst + i, expr);                                                                           \
+        }                                                                                                              \
+        _mm256_zeroupper();                                                                                            \
+        tail(a + i, b + i, dst + i, n - i);                                                                            \
+    }
+EXPR_AVX2_KERNEL(avx2_add, _mm256_add_ps(x, y), sse_add)
+EXPR_AVX2_KERNEL(avx2_sub, _mm256_sub_ps(x, y), sse_sub)
+EXPR_AVX2_KERNEL(avx2_mul, _mm256_mul_ps(x, y), sse_mul)
+EXPR_AVX2_KERNEL(avx2_div, _mm256_div_ps(x, y), sse_div)
+EXPR_AVX2_KERNEL(avx2_max, _mm256_max_ps(y, x), sse_max)
+EXPR_AVX2_KERNEL(avx2_min, _mm256_min_ps(y, x), sse_min)
+#undef EXPR_AVX2_KERNEL
+
+#define EXPR_AVX2_UNARY_KERNEL(name, expr, tail)                                                                       \
+    EXPR_TARGET_AVX2 void name(const float* a, float* dst, std::size_t n) {                                            \
+        std::size_t i = 0;                                                                                             \
+        for (; i + 8 <= n; i += 8) {                                                                                   \
+            auto x = _mm256_loadu_ps(a + i);                                                                           \
+            _mm256_storeu_ps(dst + i, expr);                                                                           \
+        }                                                                                                              \
+        _mm256_zeroupper();                                                                                            \
+        tail(a + i, dst + i, n - i);                                                                                   \
+    }
+EXPR_AVX2_UNARY_KERNEL(avx2_abs, _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x), sse_abs)
+EXPR_AVX2_UNARY_KERNEL(avx2_sqrt, _mm256_sqrt_ps(x), sse_sqrt)
+#undef EXPR_AVX2_UNARY_KERNEL
+
+bool has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+} // namespace
+
+const Table& table() {
+#ifdef EXPR_KERNELS_X86
+    static const Table sse_table{
+        sse_add,
+        sse_sub,
+        sse_mul,
+        sse_div,
+        sse_max,
+        sse_min,
+        pow,
+        sse_abs,
+        sse_sqrt,
+        exp,
+        "sse",
+    };
+    static const Table avx2_table{
+        avx2_add,
+        avx2_sub,
+        avx2_mul,
+        avx2_div,
+        avx2_max,
+        avx2_min,
+        pow,
+        avx2_abs,
+        avx2_sqrt,
+        exp,
+        "avx2",
+    };
+    static const Table& selected = has_avx2() ? avx2_table : sse_table;
+    return selected;
+#else
+    static const Table generic_table{
+        generic<AddOp>,
+        generic<SubOp>,
+        generic<MulOp>,
+        generic<DivOp>,
+        generic<MaxOp>,
+        generic<MinOp>,
+        pow,
+        generic<AbsOp>,
+        generic<SqrtOp>,
+        exp,
+        "generic",
+    };
+    return generic_table;
+#endif
+}
+} // namespace expr::kernels
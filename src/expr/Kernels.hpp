@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+
+namespace expr::kernels {
+/// dst[i] = op(a[i], b[i]) for i < n. `dst` may alias either operand.
+using Binary = void (*)(const float* a, const float* b, float* dst, std::size_t n);
+/// dst[i] = op(a[i]) for i < n. `dst` may alias `a`.
+using Unary = void (*)(const float* a, float* dst, std::size_t n);
+
+/// Elementwise kernels matching scalar::Op, including its NaN and signed-zero behaviour.
+struct Table {
+    Binary      add;
+    Binary      sub;
+    Binary      mul;
+    Binary      div;
+    Binary      max;
+    Binary      min;
+    Binary      pow;
+    Unary       abs;
+    Unary       sqrt;
+    Unary       exp;
+    const char* isa;
+};
+
+/// The widest implementation the running CPU supports, picked on first use.
+const Table& table();
+} // namespace expr::kernels
@@ -0,0 +1,63 @@
+#include "LookupTable.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace expr {
+namespace {
+float coordinate(const LookupTable::Axis& axis, float index) {
+    return axis.min + (axis.max - axis.min) * index / static_cast<float>(axis.points - 1);
+}
+} // namespace
+
+LookupTable LookupTable::build(const std::array<Axis, 3>& axes, const BatchFunction& f) {
+    LookupTable table;
+    table.mAxes = axes;
+    for (std::size_t i = 0; i < 3; i++) {
+        table.mScale[i] = static_cast<float>(axes[i].points - 1) / (axes[i].max - axes[i].min);
+    }
+    auto               count = axes[0].points * axes[1].points * axes[2].points;
+    std::vector<float> x(count), y(count), z(count);
+    std::size_t        n = 0;
+    for (std::size_t i = 0; i < axes[0].points; i++) {
+        for (std::size_t j = 0; j < axes[1].points; j++) {
+            for (std::size_t k = 0; k < axes[2].points; k++, n++) {
+                x[n] = coordinate(axes[0], static_cast<float>(i));
+                y[n] = coordinate(axes[1], static_cast<float>(j));
+                z[n] = coordinate(axes[2], static_cast<float>(k));
+            }
+        }
+    }
+    table.mValues.resize(count);
+    f(x, y, z, table.mValues);
+    return table;
+}
+
+LookupTable::Error LookupTable::measure(const BatchFunction& f) const {
+    auto               count = (mAxes[0].points - 1) * (mAxes[1].points - 1) * (mAxes[2].points - 1);
+    std::vector<float> x(count), y(count), z(count), exact(count);
+    std::size_t        n = 0;
+    for (std::size_t i = 0; i + 1 < mAxes[0].points; i++) {
+        for (std::size_t j = 0; j + 1 < mAxes[1].points; j++) {
+            for (std::size_t k = 0; k + 1 < mAxes[2].points; k++, n++) {
+                x[n] = coordinate(mAxes[0], static_cast<float>(i) + 0.5f);
+                y[n] = coordinate(mAxes[1], static_cast<float>(j) + 0.5f);
+                z[n] = coordinate(mAxes[2], static_cast<float>(k) + 0.5f);
+            }
+        }
+    }
+    f(x, y, z, exact);
+    Error  error;
+    double sum = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        auto diff = std::abs(sample(x[i], y[i], z[i]) - exact[i]);
+        // NaN compares false against everything, so it has to be caught explicitly.
+        if (std::isnan(diff)) diff = std::numeric_limits<float>::infinity();
+        error.max  = std::max(error.max, diff);
+        sum       += diff;
+    }
+    error.mean = count == 0 ? 0 : static_cast<float>(sum / static_cast<double>(count));
+    return error;
+}
+} // namespace expr
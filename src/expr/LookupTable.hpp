@@ -0,0 +1,68 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace expr {
+/// A function of three floats sampled on a regular grid and reconstructed by trilinear interpolation.
+class LookupTable {
+public:
+    struct Axis {
+        float       min;
+        float       max;
+        std::size_t points; // at least 2
+    };
+    struct Error {
+        float max  = 0;
+        float mean = 0;
+    };
+    /// Evaluates a function over samples laid out as one array per coordinate.
+    using BatchFunction = std::function<
+        void(std::span<const float> x, std::span<const float> y, std::span<const float> z, std::span<float> out)>;
+
+    /// Calls `f` once with every grid point and stores the results.
+    static LookupTable build(const std::array<Axis, 3>& axes, const BatchFunction& f);
+
+    /// Compares sample() against `f` at the centre of every cell, where interpolation is least accurate.
+    [[nodiscard]] Error measure(const BatchFunction& f) const;
+
+    [[nodiscard]] bool contains(float x, float y, float z) const {
+        return x >= mAxes[0].min && x <= mAxes[0].max && y >= mAxes[1].min && y <= mAxes[1].max
+            && z >= mAxes[2].min && z <= mAxes[2].max;
+    }
+
+    /// Interpolated value at a point for which contains() holds.
+    [[nodiscard]] float sample(float x, float y, float z) const {
+        auto [i, fx] = locate(0, x);
+        auto [j, fy] = locate(1, y);
+        auto [k, fz] = locate(2, z);
+        auto  ny     = mAxes[1].points;
+        auto  nz     = mAxes[2].points;
+        auto* p      = mValues.data() + (i * ny + j) * nz + k;
+        auto  lerp   = [](float a, float b, float t) { return a + (b - a) * t; };
+        auto  c00    = lerp(p[0], p[ny * nz], fx);
+        auto  c01    = lerp(p[1], p[ny * nz + 1], fx);
+        auto  c10    = lerp(p[nz], p[ny * nz + nz], fx);
+        auto  c11    = lerp(p[nz + 1], p[ny * nz + nz + 1], fx);
+        return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+    }
+
+    [[nodiscard]] std::size_t size() const { return mValues.size(); }
+
+private:
+    std::array<Axis, 3>  mAxes{};
+    std::array<float, 3> mScale{};
+    std::vector<float>   mValues;
+
+    // Cell index along an axis and the position inside that cell in [0, 1].
+    std::pair<std::size_t, float> locate(std::size_t axis, float v) const {
+        auto t = (v - mAxes[axis].min) * mScale[axis];
+        auto i = static_cast<std::size_t>(t);
+        if (i > mAxes[axis].points - 2) i = mAxes[axis].points - 2;
+        return {i, t - static_cast<float>(i)};
+    }
+};
+} // namespace expr
@@ -0,0 +1,505 @@
+#include "Bytecode.hpp"
+#include "Builtins.hpp"
+#include "Parser.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+
+namespace expr::bytecode {
+namespace {
+// Folded constants larger than this stay as code rather than bloating the constant pool.
+constexpr std::size_t max_folded_size = 4096;
+
+bool pure(Builtin builtin) { return builtin != Builtin::None && builtin != Builtin::Push && builtin != Builtin::Pop; }
+
+std::uint32_t bits(float v) {
+    std::uint32_t res;
+    std::memcpy(&res, &v, sizeof(res));
+    return res;
+}
+
+bool all_equal(const std::vector<float>& values, float v) {
+    return std::all_of(values.begin(), values.end(), [&](float x) { return bits(x) == bits(v); });
+}
+
+// Whether to call a built-in on these constant arguments at load time. The built-ins are defined for any
+// arguments, missing and out-of-range ones included, so this only keeps calls whose result would bloat the
+// constant pool as code.
+bool foldable(Builtin builtin, const std::vector<std::vector<float>>& args) {
+    auto count = [&](std::size_t i) {
+        return i < args.size() && !args[i].empty() ? builtins::count(args[i][0]) : std::size_t{0};
+    };
+    switch (builtin) {
+    case Builtin::Tuple:
+        return count(0) <= max_folded_size;
+    case Builtin::Subtuple:
+        return count(1) <= count(0) || count(1) - count(0) <= max_folded_size;
+    case Builtin::Con: {
+        std::size_t size = 0;
+        for (auto& arg : args) size += arg.size();
+        return size <= max_folded_size;
+    }
+    default:
+        return true;
+    }
+}
+
+struct Optimizer {
+    Chunk&           chunk;
+    std::string_view text;  // the source, for error positions
+    std::string      error; // the first out-of-bounds call, or the constant pool overflowing
+
+    // Indexed by the original registers: the register now holding the same value, the value if it is
+    // known at load time, and the element count or -1 if that is unknown.
+    std::vector<std::uint16_t>                          alias;
+    std::vector<std::optional<std::vector<float>>>      known;
+    std::vector<int>                                    length;
+    // Pure computations already emitted, keyed by op and resolved operands (or value for constants).
+    std::map<std::vector<std::uint32_t>, std::uint16_t> available;
+
+    std::vector<Instr>         code;
+    std::vector<Call>          calls;
+    std::vector<std::uint16_t> operands;
+
+    std::uint16_t resolve(std::uint16_t reg) const { return alias[reg]; }
+
+    void make_constant(Instr instr, std::vector<float> value) {
+        length[instr.dst] = static_cast<int>(value.size());
+        std::vector<std::uint32_t> key{static_cast<std::uint32_t>(Op::Const)};
+        for (auto v : value) key.push_back(bits(v));
+        if (auto it = available.find(key); it != available.end()) {
+            alias[instr.dst] = it->second;
+            known[instr.dst] = known[it->second];
+            return;
+        }
+        if (chunk.constants.size() > std::numeric_limits<std::uint16_t>::max()) {
+            if (error.empty()) error = "program is too large";
+            return;
+        }
+        available.emplace(std::move(key), instr.dst);
+        chunk.constants.push_back(value);
+        known[instr.dst] = std::move(value);
+        code.push_back({Op::Const, instr.dst, static_cast<std::uint16_t>(chunk.constants.size() - 1), 0});
+    }
+
+    // Reuses an earlier register computing the same pure value; returns false if this is the first one.
+    bool reuse(std::uint16_t dst, std::vector<std::uint32_t> key) {
+        auto [it, inserted] = available.emplace(std::move(key), dst);
+        if (inserted) return false;
+        alias[dst]  = it->second;
+        length[dst] = length[it->second];
+        return true;
+    }
+
+    // x op c == x when c's elements are all the identity and c is at least as long as x.
+    std::optional<std::uint16_t> identity(Op op, std::uint16_t a, std::uint16_t b) const {
+        auto is = [&](std::uint16_t c, std::uint16_t x, float v) {
+            return known[c] && length[x] >= 0 && known[c]->size() >= static_cast<std::size_t>(length[x])
+                && all_equal(*known[c], v);
+        };
+        switch (op) {
+        case Op::Add: // x + -0 == x for every x, including -0; x + +0 is not
+            if (is(b, a, -0.0f)) return a;
+            if (is(a, b, -0.0f)) return b;
+            break;
+        case Op::Sub:
+            if (is(b, a, 0.0f)) return a;
+            break;
+        case Op::Mul:
+            if (is(b, a, 1.0f)) return a;
+            if (is(a, b, 1.0f)) return b;
+            break;
+        case Op::Div:
+            if (is(b, a, 1.0f)) return a;
+            break;
+        default:
+            break;
+        }
+        return std::nullopt;
+    }
+
+    void arithmetic(Instr instr) {
+        auto a = resolve(instr.a);
+        auto b = resolve(instr.b);
+        if (known[a] && known[b]) {
+            auto&              x = *known[a];
+            auto&              y = *known[b];
+            std::vector<float> value(std::min(x.size(), y.size()));
+            for (std::size_t i = 0; i < value.size(); i++) {
+                switch (instr.op) {
+                case Op::Add:
+                    value[i] = x[i] + y[i];
+                    break;
+                case Op::Sub:
+                    value[i] = x[i] - y[i];
+                    break;
+                case Op::Mul:
+                    value[i] = x[i] * y[i];
+                    break;
+                default:
+                    value[i] = x[i] / y[i];
+                    break;
+                }
+            }
+            make_constant(instr, std::move(value));
+            return;
+        }
+        if (auto x = identity(instr.op, a, b)) {
+            alias[instr.dst]  = *x;
+            length[instr.dst] = length[*x];
+            return;
+        }
+        length[instr.dst] = length[a] >= 0 && length[b] >= 0 ? std::min(length[a], length[b])
+                          : length[a] == 0 || length[b] == 0 ? 0
+                                                             : -1;
+        if (reuse(instr.dst, {static_cast<std::uint32_t>(instr.op), a, b})) return;
+        code.push_back({instr.op, instr.dst, a, b});
+    }
+
+    // The first element of argument `i` if it is known at load time, as builtins::call reads it.
+    std::optional<std::size_t> index(const std::vector<std::uint16_t>& args, std::size_t i) const {
+        if (i >= args.size()) return 0;
+        auto& value = known[args[i]];
+        if (!value) return std::nullopt;
+        return value->empty() ? 0 : builtins::count((*value)[0]);
+    }
+    int size(const std::vector<std::uint16_t>& args, std::size_t i) const {
+        return i < args.size() ? length[args[i]] : 0;
+    }
+
+    // of and subtuple with a constant index past the end of a tuple of known length.
+    void check_bounds(const Call& call, const std::vector<std::uint16_t>& args) {
+        auto fail = [&](std::string_view what, std::size_t value, int elements) {
+            if (!error.empty()) return;
+            error = std::string(what) + " " + std::to_string(value) + " is past the end of a tuple of "
+                  + std::to_string(elements) + (elements == 1 ? " element" : " elements") + " in '"
+                  + std::string(builtins::name(call.builtin)) + "'" + parser::position(text, call.offset);
+        };
+        if (call.builtin == Builtin::Of) {
+            auto i = index(args, 0);
+            auto n = size(args, 1);
+            if (i && n >= 0 && *i >= static_cast<std::size_t>(n)) fail("index", *i, n);
+        } else if (call.builtin == Builtin::Subtuple) {
+            auto begin = index(args, 0);
+            auto end   = index(args, 1);
+            auto n     = size(args, 2);
+            if (n < 0) return;
+            if (begin && *begin > static_cast<std::size_t>(n)) fail("start", *begin, n);
+            if (end && *end > static_cast<std::size_t>(n)) fail("end", *end, n);
+        }
+    }
+
+    void call(Instr instr) {
+        auto&                      source = chunk.calls[instr.a];
+        std::vector<std::uint16_t> args;
+        for (std::uint32_t i = 0; i < source.count; i++) args.push_back(resolve(chunk.operands[source.first + i]));
+
+        if (pure(source.builtin)) {
+            check_bounds(source, args);
+            bool                            constant = true;
+            std::vector<std::vector<float>> values;
+            for (auto arg : args) {
+                if (!known[arg]) {
+                    constant = false;
+                    break;
+                }
+                values.push_back(*known[arg]);
+            }
+            if (constant && foldable(source.builtin, values)) {
+                make_constant(instr, builtins::fold(source.builtin, values));
+                return;
+            }
+            // len only depends on the shapes of its arguments.
+            if (source.builtin == Builtin::Len
+                && std::all_of(args.begin(), args.end(), [&](std::uint16_t arg) { return length[arg] >= 0; })) {
+                std::vector<float> value;
+                for (auto arg : args) value.push_back(static_cast<float>(length[arg]));
+                make_constant(instr, std::move(value));
+                return;
+            }
+            // con(x), max(x), min(x) and sort(x) are x itself when x has at most one element.
+            auto single = args.size() == 1 && length[args[0]] >= 0 && length[args[0]] <= 1;
+            if ((source.builtin == Builtin::Con && args.size() == 1)
+                || (single && length[args[0]] == 1
+                    && (source.builtin == Builtin::Max || source.builtin == Builtin::Min))
+                || (single && source.builtin == Builtin::Sort)) {
+                alias[instr.dst]  = args[0];
+                length[instr.dst] = length[args[0]];
+                return;
+            }
+            length[instr.dst] = result_length(source.builtin, args);
+            std::vector<std::uint32_t> key{
+                static_cast<std::uint32_t>(Op::Call),
+                static_cast<std::uint32_t>(source.builtin),
+            };
+            key.insert(key.end(), args.begin(), args.end());
+            if (reuse(instr.dst, std::move(key))) return;
+        } else {
+            // push returns its argument.
+            length[instr.dst] = source.builtin == Builtin::Push ? size(args, 0) : -1;
+        }
+        calls.push_back(
+            {source.function,
+             source.builtin,
+             static_cast<std::uint32_t>(operands.size()),
+             source.count,
+             source.offset}
+        );
+        operands.insert(operands.end(), args.begin(), args.end());
+        code.push_back({Op::Call, instr.dst, static_cast<std::uint16_t>(calls.size() - 1), 0});
+    }
+
+    int result_length(Builtin builtin, const std::vector<std::uint16_t>& args) const {
+        switch (builtin) {
+        case Builtin::Of:
+        case Builtin::Sum:
+        case Builtin::Max:
+        case Builtin::Min:
+            return 1;
+        case Builtin::Len:
+            return static_cast<int>(args.size());
+        case Builtin::Tuple: {
+            auto count = index(args, 0);
+            return count ? static_cast<int>(*count) : -1;
+        }
+        // b - a elements whatever the tuple's length.
+        case Builtin::Subtuple: {
+            auto begin = index(args, 0);
+            auto end   = index(args, 1);
+            if (!begin || !end) return -1;
+            return *end > *begin ? static_cast<int>(*end - *begin) : 0;
+        }
+        case Builtin::Sort:
+            return args.empty() ? -1 : length[args[0]];
+        case Builtin::Con: {
+            int total = 0;
+            for (auto arg : args) {
+                if (length[arg] < 0) return -1;
+                total += length[arg];
+            }
+            return total;
+        }
+        case Builtin::Abs:
+        case Builtin::Neg:
+        case Builtin::Sqrt:
+        case Builtin::Exp:
+        case Builtin::Spline:
+            return shortest(args, 1);
+        case Builtin::Pow:
+            return shortest(args, 2);
+        case Builtin::Clamp:
+        case Builtin::Lerp:
+        case Builtin::Smoothstep:
+            return shortest(args, 3);
+        default:
+            return -1;
+        }
+    }
+
+    // Length of an elementwise result over the first `n` arguments; a missing one counts as empty.
+    int shortest(const std::vector<std::uint16_t>& args, std::size_t n) const {
+        if (args.size() < n) return 0;
+        bool unknown = false;
+        int  res     = std::numeric_limits<int>::max();
+        for (std::size_t i = 0; i < n; i++) {
+            if (length[args[i]] == 0) return 0;
+            if (length[args[i]] < 0) unknown = true;
+            else res = std::min(res, length[args[i]]);
+        }
+        return unknown ? -1 : res;
+    }
+
+    void run() {
+        auto registers = chunk.registers;
+        alias.resize(registers);
+        for (std::uint16_t i = 0; i < registers; i++) alias[i] = i;
+        known.resize(registers);
+        length.assign(registers, -1);
+
+        for (auto instr : chunk.code) {
+            switch (instr.op) {
+            case Op::Const:
+                make_constant(instr, chunk.constants[instr.a]);
+                break;
+            case Op::Param:
+                length[instr.dst] = 1;
+                if (!reuse(instr.dst, {static_cast<std::uint32_t>(Op::Param), instr.a})) code.push_back(instr);
+                break;
+            case Op::Call:
+                call(instr);
+                break;
+            default:
+                arithmetic(instr);
+                break;
+            }
+        }
+        chunk.result = resolve(chunk.result);
+        eliminate();
+    }
+
+    // Drops instructions whose value is never read, except calls with effects, then renumbers the
+    // surviving registers densely and rebuilds the constant pool.
+    void eliminate() {
+        std::vector<bool> live(chunk.registers, false);
+        live[chunk.result] = true;
+        std::vector<bool> keep(code.size(), false);
+        for (auto i = code.size(); i-- > 0;) {
+            auto& instr = code[i];
+            if (!live[instr.dst] && !(instr.op == Op::Call && !pure(calls[instr.a].builtin))) continue;
+            keep[i]         = true;
+            live[instr.dst] = true;
+            switch (instr.op) {
+            case Op::Add:
+            case Op::Sub:
+            case Op::Mul:
+            case Op::Div:
+                live[instr.a] = live[instr.b] = true;
+                break;
+            case Op::Call:
+                for (std::uint32_t j = 0; j < calls[instr.a].count; j++) {
+                    live[operands[calls[instr.a].first + j]] = true;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        Chunk                      res;
+        std::vector<std::uint16_t> number(chunk.registers, 0);
+        for (std::size_t i = 0; i < code.size(); i++) {
+            if (!keep[i]) continue;
+            auto instr = code[i];
+            switch (instr.op) {
+            case Op::Const:
+                res.constants.push_back(std::move(chunk.constants[instr.a]));
+                instr.a = static_cast<std::uint16_t>(res.constants.size() - 1);
+                break;
+            case Op::Param:
+                break;
+            case Op::Call: {
+                auto call  = calls[instr.a];
+                auto first = static_cast<std::uint32_t>(res.operands.size());
+                for (std::uint32_t j = 0; j < call.count; j++) {
+                    res.operands.push_back(number[operands[call.first + j]]);
+                }
+                call.first = first;
+                res.calls.push_back(call);
+                instr.a = static_cast<std::uint16_t>(res.calls.size() - 1);
+                break;
+            }
+            default:
+                instr.a = number[instr.a];
+                instr.b = number[instr.b];
+                break;
+            }
+            instr.dst           = res.registers++;
+            number[code[i].dst] = instr.dst;
+            res.code.push_back(instr);
+            res.lengths.push_back(length[code[i].dst]);
+            res.sources.push_back(chunk.sources[code[i].dst]);
+        }
+        res.result = number[chunk.result];
+        chunk      = std::move(res);
+    }
+};
+
+bool is_arithmetic(Op op) { return op == Op::Add || op == Op::Sub || op == Op::Mul || op == Op::Div; }
+
+// Turns each tree of arithmetic whose inner values have no other reader into one Loop instruction at
+// the position of its root. `a * b + c * d - e` then reads each input once and writes one result,
+// instead of making a pass and a temporary tuple per operation.
+void fuse_loops(Chunk& chunk) {
+    constexpr auto             none = std::numeric_limits<std::uint16_t>::max();
+    std::vector<std::size_t>   definition(chunk.registers, 0);
+    std::vector<std::uint32_t> reads(chunk.registers, 0), arithmetic_reads(chunk.registers, 0);
+    reads[chunk.result]++;
+    for (std::size_t i = 0; i < chunk.code.size(); i++) {
+        auto& instr           = chunk.code[i];
+        definition[instr.dst] = i;
+        if (is_arithmetic(instr.op)) {
+            for (auto reg : {instr.a, instr.b}) {
+                reads[reg]++;
+                arithmetic_reads[reg]++;
+            }
+        } else if (instr.op == Op::Call) {
+            auto& call = chunk.calls[instr.a];
+            for (std::uint32_t j = 0; j < call.count; j++) reads[chunk.operands[call.first + j]]++;
+        }
+    }
+    // Computed inside the loop of the one operation reading it.
+    auto inner = [&](std::uint16_t reg) {
+        return is_arithmetic(chunk.code[definition[reg]].op) && reads[reg] == 1 && arithmetic_reads[reg] == 1;
+    };
+
+    std::vector<Instr>         code;
+    std::vector<std::uint16_t> input(chunk.registers, none); // index in the current loop
+    std::vector<std::uint16_t> inputs;
+    for (auto& root : chunk.code) {
+        if (is_arithmetic(root.op) && inner(root.dst)) continue; // part of its reader's loop
+        if (!is_arithmetic(root.op) || (!inner(root.a) && !inner(root.b))) {
+            code.push_back(root);
+            continue;
+        }
+        // Postorder without recursion, since a long chain is as deep as it is long. Temporaries are
+        // numbered by their depth on the evaluation stack; inputs get `none - index` until their count
+        // is known. Inputs and temporaries are distinct registers, so together they number fewer than
+        // `none` and the two ranges can't meet.
+        Loop                                        loop{static_cast<std::uint32_t>(chunk.operands.size()), 0, {}, 0};
+        std::vector<std::pair<std::uint16_t, bool>> pending{{root.dst, false}};
+        std::uint16_t                               depth = 0;
+        while (!pending.empty()) {
+            auto [reg, expanded] = pending.back();
+            pending.pop_back();
+            auto& instr = chunk.code[definition[reg]];
+            if (!expanded) {
+                pending.push_back({reg, true});
+                if (inner(instr.b)) pending.push_back({instr.b, false});
+                if (inner(instr.a)) pending.push_back({instr.a, false});
+                continue;
+            }
+            auto operand = [&](std::uint16_t value) -> std::uint16_t {
+                if (inner(value)) return --depth;
+                if (input[value] == none) {
+                    input[value] = static_cast<std::uint16_t>(inputs.size());
+                    inputs.push_back(value);
+                }
+                return static_cast<std::uint16_t>(none - input[value]);
+            };
+            auto b = operand(instr.b);
+            auto a = operand(instr.a);
+            loop.code.push_back({instr.op, depth, a, b});
+            loop.temps = std::max<std::uint16_t>(loop.temps, ++depth);
+        }
+        loop.count = static_cast<std::uint32_t>(inputs.size());
+        for (auto& step : loop.code) {
+            for (auto* operand : {&step.a, &step.b}) {
+                *operand = *operand > none - inputs.size() ? static_cast<std::uint16_t>(none - *operand)
+                                                           : static_cast<std::uint16_t>(loop.count + *operand);
+            }
+        }
+        for (auto reg : inputs) input[reg] = none;
+        chunk.operands.insert(chunk.operands.end(), inputs.begin(), inputs.end());
+        inputs.clear();
+        chunk.loops.push_back(std::move(loop));
+        code.push_back({Op::Loop, root.dst, static_cast<std::uint16_t>(chunk.loops.size() - 1), 0});
+    }
+    chunk.code = std::move(code);
+}
+} // namespace
+
+bool optimize(Chunk& chunk, std::string_view code, std::string* error) {
+    Optimizer optimizer{chunk, code, {}, {}, {}, {}, {}, {}, {}, {}};
+    optimizer.run();
+    if (!optimizer.error.empty()) {
+        if (error) *error = std::move(optimizer.error);
+        return false;
+    }
+    fuse_loops(chunk);
+    return true;
+}
+} // namespace expr::bytecode
@@ -0,0 +1,454 @@
+#include "Parser.hpp"
+#include "Builtins.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+namespace expr::parser {
+namespace {
+constexpr std::array<std::string_view, static_cast<std::size_t>(Slot::Count)> slot_names{
+    "ori",
+    "continentalness",
+    "erosion",
+    "weirdness",
+};
+
+// Parentheses, calls and unary minus recurse in the parser; deeper input is rejected rather than overflowing
+// the stack.
+constexpr int max_depth = 256;
+// Lowering and the tree walker recurse once per level of the syntax tree, which a chain of binary operators
+// deepens by one per operator without any parser recursion, so the height of the tree is limited too. Even
+// unoptimized builds then use well under the 1 MB default stack of Windows threads, which the hot reload
+// watcher compiles on.
+constexpr std::size_t max_height = 2048;
+// Syntax tree nodes a formula or definition may stand for once definitions are inlined. Definitions that
+// call each other twice over double in size at every level, and lowering visits every inlined node.
+constexpr std::size_t max_nodes = std::size_t{1} << 16;
+
+enum class Kind : std::uint8_t { Number, Name, Plus, Minus, Star, Slash, Open, Close, Comma, Semicolon, Equals, End };
+
+struct Token {
+    Kind          kind;
+    std::uint32_t symbol = 0; // names: index into Parser::symbols
+    float         value  = 0; // numbers
+    std::size_t   offset = 0; // into the code
+    std::size_t   length = 0;
+};
+
+// What a name stands for, found when it is first seen.
+struct Symbol {
+    std::string_view  name;
+    int               slot       = -1;
+    int               local      = -1; // set once an assignment to the name has been parsed
+    int               arg        = -1; // set while the body of a definition with this parameter is parsed
+    Builtin           builtin    = Builtin::None;
+    const Function*   function   = nullptr; // shadows `builtin`
+    const Definition* definition = nullptr; // shadows `function` and `builtin`
+};
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+bool is_name_start(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+
+// Parsing stops at the first error: fail() records it and returns nullptr, which every parse function
+// passes straight up.
+struct Parser {
+    std::string_view                                    code;
+    const FunctionTable&                                functions;
+    std::span<const Definition* const>                  definitions;
+    Arena&                                              arena;
+    std::vector<Token>                                  tokens;
+    std::vector<Symbol>                                 symbols;
+    std::unordered_map<std::string_view, std::uint32_t> interned;
+    std::size_t                                         next   = 0;
+    int                                                 depth  = 0;
+    std::uint16_t                                       locals = 0;
+    std::size_t                                         nodes  = 0; // made so far, counting inlined ones
+    std::size_t                                         height = 0; // of the tree last parsed
+    std::string                                         error;
+
+    Parser(
+        std::string_view                   code,
+        const FunctionTable&               functions,
+        std::span<const Definition* const> definitions,
+        Arena&                             arena
+    )
+    : code(code),
+      functions(functions),
+      definitions(definitions),
+      arena(arena) {}
+
+    std::nullptr_t fail(std::size_t offset, std::string message) {
+        error = std::move(message) + position(code, offset);
+        return nullptr;
+    }
+    std::nullptr_t fail(const Token& token, std::string message) { return fail(token.offset, std::move(message)); }
+
+    static std::uint32_t offset(const Token& token) { return static_cast<std::uint32_t>(token.offset); }
+    [[nodiscard]] std::string_view text(const Token& token) const { return code.substr(token.offset, token.length); }
+    [[nodiscard]] std::string describe(const Token& token) const {
+        return token.kind == Kind::End ? "end of input" : "'" + std::string(text(token)) + "'";
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        nodes++;
+        return arena.make<T>(std::forward<Args>(args)...);
+    }
+    // Records the height of the tree `node` roots, failing at `token` if it is too tall.
+    Expr* rooted(Expr* node, std::size_t height, const Token& token) {
+        if (height > max_height) return fail(token, "expression too long or nested too deeply");
+        this->height = height;
+        return node;
+    }
+    // Records that `node` was parsed from the tokens from `first` up to the last one consumed.
+    Expr* spanned(Expr* node, std::size_t first) {
+        if (!node) return nullptr;
+        auto& last   = tokens[next - 1];
+        node->source = {offset(tokens[first]), static_cast<std::uint32_t>(last.offset + last.length)};
+        return node;
+    }
+
+    std::uint32_t intern(std::string_view name) {
+        auto [it, inserted] = interned.try_emplace(name, static_cast<std::uint32_t>(symbols.size()));
+        if (!inserted) return it->second;
+        Symbol symbol{name};
+        if (auto slot = std::find(slot_names.begin(), slot_names.end(), name); slot != slot_names.end()) {
+            symbol.slot = static_cast<int>(slot - slot_names.begin());
+        }
+        auto definition = std::find_if(definitions.begin(), definitions.end(), [&](const Definition* d) {
+            return d->name == name;
+        });
+        if (definition != definitions.end()) {
+            symbol.definition = *definition;
+        } else if (auto function = functions.find(std::string(name)); function != functions.end()) {
+            symbol.function = &function->second;
+        } else {
+            symbol.builtin = builtins::find(name);
+        }
+        symbols.push_back(symbol);
+        return it->second;
+    }
+
+    bool tokenize() {
+        for (std::size_t i = 0; i < code.size();) {
+            auto c = code[i];
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                i++;
+                continue;
+            }
+            Token token{Kind::End, 0, 0, i};
+            if (is_name_start(c)) {
+                auto end = i + 1;
+                while (end < code.size() && (is_name_start(code[end]) || is_digit(code[end]))) end++;
+                token.kind   = Kind::Name;
+                token.symbol = intern(code.substr(i, end - i));
+                i            = end;
+            } else if (is_digit(c) || c == '.') {
+                auto end = i + 1;
+                while (end < code.size() && (is_digit(code[end]) || code[end] == '.')) end++;
+                // An exponent only if digits follow, so `2e` is a number and a name.
+                if (end < code.size() && (code[end] == 'e' || code[end] == 'E')) {
+                    auto sign   = end + 1 < code.size() && (code[end + 1] == '+' || code[end + 1] == '-');
+                    auto digits = end + (sign ? 2 : 1);
+                    if (digits < code.size() && is_digit(code[digits])) {
+                        end = digits;
+                        while (end < code.size() && is_digit(code[end])) end++;
+                    }
+                }
+                auto [ptr, ec] = std::from_chars(code.data() + i, code.data() + end, token.value);
+                if (ec == std::errc::result_out_of_range) {
+                    fail(i, "number '" + std::string(code.substr(i, end - i)) + "' is out of range");
+                    return false;
+                }
+                if (ec != std::errc{} || ptr != code.data() + end) {
+                    fail(i, "invalid number '" + std::string(code.substr(i, end - i)) + "'");
+                    return false;
+                }
+                token.kind = Kind::Number;
+                i          = end;
+            } else {
+                switch (c) {
+                case '+': token.kind = Kind::Plus; break;
+                case '-': token.kind = Kind::Minus; break;
+                case '*': token.kind = Kind::Star; break;
+                case '/': token.kind = Kind::Slash; break;
+                case '(': token.kind = Kind::Open; break;
+                case ')': token.kind = Kind::Close; break;
+                case ',': token.kind = Kind::Comma; break;
+                case ';': token.kind = Kind::Semicolon; break;
+                case '=': token.kind = Kind::Equals; break;
+                default:
+                    fail(i, "unexpected character '" + std::string(1, c) + "'");
+                    return false;
+                }
+                i++;
+            }
+            token.length = i - token.offset;
+            tokens.push_back(token);
+        }
+        tokens.push_back({Kind::End, 0, 0, code.size()});
+        return true;
+    }
+
+    bool accept(Kind kind) {
+        if (tokens[next].kind != kind) return false;
+        next++;
+        return true;
+    }
+    bool expect(Kind kind, std::string_view what) {
+        if (accept(kind)) return true;
+        fail(tokens[next], "expected " + std::string(what) + ", found " + describe(tokens[next]));
+        return false;
+    }
+
+    // Binding strength of a binary operator; 0 for tokens that end an expression.
+    static int precedence(Kind kind) {
+        switch (kind) {
+        case Kind::Plus:
+        case Kind::Minus:
+            return 1;
+        case Kind::Star:
+        case Kind::Slash:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    // Operators of the same precedence group to the left: `a - b - c` is `(a - b) - c`.
+    Expr* expression(int min = 1) {
+        auto first = next;
+        auto lhs   = unary();
+        while (lhs) {
+            auto& op         = tokens[next];
+            auto  precedence = Parser::precedence(op.kind);
+            if (precedence < min) break;
+            next++;
+            auto lhs_height = height;
+            auto rhs        = expression(precedence + 1);
+            if (!rhs) return nullptr;
+            switch (op.kind) {
+            case Kind::Plus: lhs = make<AddExpr>(lhs, rhs); break;
+            case Kind::Minus: lhs = make<SubExpr>(lhs, rhs); break;
+            case Kind::Star: lhs = make<MulExpr>(lhs, rhs); break;
+            default: lhs = make<DivExpr>(lhs, rhs); break;
+            }
+            lhs = spanned(rooted(lhs, std::max(lhs_height, height) + 1, op), first);
+        }
+        return lhs;
+    }
+
+    // Parentheses and call arguments.
+    Expr* nested() {
+        if (depth == max_depth) return fail(tokens[next], "expression nested too deeply");
+        depth++;
+        auto res = expression();
+        depth--;
+        return res;
+    }
+
+    // Unary minus binds tighter than any binary operator and negates every element. A negated number is
+    // read as a negative constant.
+    Expr* unary() {
+        auto  first = next;
+        auto& minus = tokens[next];
+        if (!accept(Kind::Minus)) return spanned(primary(), first);
+        if (tokens[next].kind == Kind::Number) {
+            height = 1;
+            return spanned(make<TupleExpr>(std::vector<float>{-tokens[next++].value}), first);
+        }
+        if (depth == max_depth) return fail(tokens[next], "expression nested too deeply");
+        depth++;
+        auto operand = unary();
+        depth--;
+        if (!operand) return nullptr;
+        auto neg = make<CallExpr>(nullptr, Builtin::Neg, std::vector<Expr*>{operand}, offset(minus));
+        return spanned(rooted(neg, height + 1, minus), first);
+    }
+
+    Expr* primary() {
+        auto& token = tokens[next++];
+        switch (token.kind) {
+        case Kind::Number:
+            height = 1;
+            return make<TupleExpr>(std::vector<float>{token.value});
+        case Kind::Name:
+            return tokens[next].kind == Kind::Open ? call(token) : variable(token);
+        case Kind::Open: {
+            auto value = nested();
+            if (!value || !expect(Kind::Close, "')'")) return nullptr;
+            return value;
+        }
+        default:
+            return fail(token, "expected a value, found " + describe(token));
+        }
+    }
+
+    Expr* variable(const Token& token) {
+        auto& symbol = symbols[token.symbol];
+        height       = 1;
+        if (symbol.arg >= 0) return make<ArgExpr>(static_cast<std::uint16_t>(symbol.arg));
+        if (symbol.local >= 0) return make<LocalExpr>(static_cast<std::uint16_t>(symbol.local));
+        if (symbol.slot >= 0) return make<ParamExpr>(static_cast<Slot>(symbol.slot));
+        return fail(token, "unknown parameter '" + std::string(symbol.name) + "'");
+    }
+
+    Expr* call(const Token& token) {
+        auto& symbol = symbols[token.symbol];
+        if (!symbol.definition && !symbol.function && symbol.builtin == Builtin::None) {
+            return fail(token, "unknown function '" + std::string(symbol.name) + "'");
+        }
+        next++; // '('
+        std::vector<Expr*> args;
+        std::size_t        tallest = 0;
+        if (!accept(Kind::Close)) {
+            do {
+                auto arg = nested();
+                if (!arg) return nullptr;
+                args.push_back(arg);
+                tallest = std::max(tallest, height);
+            } while (accept(Kind::Comma));
+            if (!expect(Kind::Close, "',' or ')'")) return nullptr;
+        }
+        if (auto definition = symbol.definition) {
+            if (args.size() != definition->params) {
+                return fail(
+                    token,
+                    "'" + std::string(symbol.name) + "' takes " + std::to_string(definition->params)
+                        + (definition->params == 1 ? " argument" : " arguments") + ", found "
+                        + std::to_string(args.size())
+                );
+            }
+            nodes += definition->size;
+            if (nodes > max_nodes) return fail(token, "too large with '" + std::string(symbol.name) + "' inlined");
+            // The body runs below the call, after the arguments.
+            auto inlined = std::max(tallest, definition->height) + 1;
+            return rooted(make<InlineExpr>(definition, std::move(args)), inlined, token);
+        }
+        auto res = make<CallExpr>(symbol.function, symbol.builtin, std::move(args), offset(token));
+        return rooted(res, tallest + 1, token);
+    }
+
+    // `name = value` or a bare expression. The name only becomes visible after its value is parsed, so
+    // `h = h * 2;` reads the previous `h`.
+    Expr* statement() {
+        auto& first = tokens[next];
+        if (first.kind == Kind::Semicolon) return fail(first, "empty statement");
+        if (tokens[next + 1].kind != Kind::Equals) return expression();
+        if (first.kind != Kind::Name) return fail(first, "cannot assign to " + describe(first));
+        auto& symbol = symbols[first.symbol];
+        if (symbol.slot >= 0) return fail(first, "cannot assign to parameter '" + std::string(symbol.name) + "'");
+        next += 2;
+        if (tokens[next].kind == Kind::Semicolon) return fail(tokens[next], "missing value after '='");
+        auto value = expression();
+        if (!value) return nullptr;
+        if (symbol.local < 0) {
+            if (locals == std::numeric_limits<std::uint16_t>::max()) return fail(first, "too many variables");
+            symbol.local = locals++;
+        }
+        return rooted(make<AssignExpr>(static_cast<std::uint16_t>(symbol.local), value), height + 1, first);
+    }
+
+    // `name(params) = body`. The name becomes callable once the body is parsed, so a definition can only
+    // call the ones before it and inlining always ends.
+    const Definition* definition() {
+        auto& name = tokens[next];
+        if (!expect(Kind::Name, "a function name")) return nullptr;
+        auto& symbol = symbols[name.symbol];
+        if (symbol.slot >= 0) return fail(name, "cannot define parameter '" + std::string(symbol.name) + "'");
+        if (symbol.definition) return fail(name, "'" + std::string(symbol.name) + "' is already defined");
+        if (!expect(Kind::Open, "'('")) return nullptr;
+        std::vector<std::uint32_t> params;
+        if (!accept(Kind::Close)) {
+            do {
+                auto& param = tokens[next];
+                if (!expect(Kind::Name, "a parameter name")) return nullptr;
+                auto& arg = symbols[param.symbol];
+                if (arg.slot >= 0) return fail(param, "cannot redefine parameter '" + std::string(arg.name) + "'");
+                if (std::find(params.begin(), params.end(), param.symbol) != params.end()) {
+                    return fail(param, "duplicate parameter '" + std::string(arg.name) + "'");
+                }
+                if (params.size() == std::numeric_limits<std::uint16_t>::max()) {
+                    return fail(param, "too many parameters");
+                }
+                params.push_back(param.symbol);
+            } while (accept(Kind::Comma));
+            if (!expect(Kind::Close, "',' or ')'")) return nullptr;
+        }
+        if (!expect(Kind::Equals, "'='")) return nullptr;
+        for (std::size_t i = 0; i < params.size(); i++) symbols[params[i]].arg = static_cast<int>(i);
+        nodes     = 0;
+        auto body = expression();
+        for (auto param : params) symbols[param].arg = -1;
+        if (!body) return nullptr;
+        symbol.definition = arena.make<Definition>(
+            Definition{symbol.name, static_cast<std::uint16_t>(params.size()), body, nodes, height}
+        );
+        return symbol.definition;
+    }
+};
+} // namespace
+
+std::string position(std::string_view code, std::size_t offset) {
+    std::size_t line = 1, column = 1;
+    for (std::size_t i = 0; i < offset && i < code.size(); i++) {
+        if (code[i] == '\n') {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+    if (code.find('\n') == std::string_view::npos) return " at column " + std::to_string(column);
+    return " at line " + std::to_string(line) + ", column " + std::to_string(column);
+}
+
+std::optional<Program> parse(
+    std::string_view                   code,
+    const FunctionTable&               functions,
+    std::span<const Definition* const> definitions,
+    Arena&                             arena,
+    std::string*                       error
+) {
+    Parser  parser{code, functions, definitions, arena};
+    Program program;
+    if (parser.tokenize()) {
+        while (parser.tokens[parser.next].kind != Kind::End) {
+            auto statement = parser.statement();
+            if (!statement || !parser.expect(Kind::Semicolon, "';'")) break;
+            program.statements.push_back(statement);
+        }
+    }
+    if (parser.error.empty() && program.statements.empty()) {
+        parser.error = "expected at least one statement ending in ';'";
+    }
+    if (!parser.error.empty()) {
+        if (error) *error = std::move(parser.error);
+        return std::nullopt;
+    }
+    program.locals = parser.locals;
+    return program;
+}
+
+std::optional<std::vector<const Definition*>>
+parse_definitions(std::string_view code, const FunctionTable& functions, Arena& arena, std::string* error) {
+    Parser                         parser{code, functions, {}, arena};
+    std::vector<const Definition*> definitions;
+    if (parser.tokenize()) {
+        while (parser.tokens[parser.next].kind != Kind::End) {
+            auto definition = parser.definition();
+            if (!definition || !parser.expect(Kind::Semicolon, "';'")) break;
+            definitions.push_back(definition);
+        }
+    }
+    if (!parser.error.empty()) {
+        if (error) *error = std::move(parser.error);
+        return std::nullopt;
+    }
+    return definitions;
+}
+} // namespace expr::parser
@@ -0,0 +1,39 @@
+#pragma once
+#include "Arena.hpp"
+#include "Ast.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace expr::parser {
+/// The syntax trees of a program's statements, allocated from the arena given to parse().
+struct Program {
+    std::vector<Expr*> statements;
+    std::uint16_t      locals = 0; // variables, numbered in order of their first assignment
+};
+
+/// Parses `code` in time linear in its length: one pass to tokenize it, in which each distinct name is
+/// resolved to a parameter, variable or function once, and one recursive descent over the tokens.
+/// Returns std::nullopt and sets `*error` to the first error and its position if the code is malformed.
+/// Calls to `definitions` become InlineExpr nodes, whose arguments must match the definition's parameters.
+std::optional<Program> parse(
+    std::string_view                   code,
+    const FunctionTable&               functions,
+    std::span<const Definition* const> definitions,
+    Arena&                             arena,
+    std::string*                       error
+);
+
+/// Parses definitions `name(params) = body;`, in the same way as parse(). A body is one expression, which
+/// reads the parameters by name and may call built-ins, `functions` and earlier definitions.
+std::optional<std::vector<const Definition*>>
+parse_definitions(std::string_view code, const FunctionTable& functions, Arena& arena, std::string* error);
+
+/// " at column C", or " at line L, column C" if `code` has several lines: where `offset` is, for the end
+/// of an error message.
+std::string position(std::string_view code, std::size_t offset);
+} // namespace expr::parser
@@ -0,0 +1,448 @@
+#include "Scalar.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <tuple>
+
+namespace expr::scalar {
+namespace {
+constexpr std::size_t slot_count = static_cast<std::size_t>(Slot::Count);
+
+// A float during specialization, before registers are numbered.
+struct Ref {
+    enum class Kind : std::uint8_t { Slot, Const, Temp } kind;
+    std::uint16_t index;
+};
+using List = std::vector<Ref>;
+
+struct Specializer {
+    const bytecode::Chunk&           source;
+    std::vector<float>               constants;
+    std::vector<Spline>              splines;
+    std::vector<Instr>               code; // operands are encode()d Refs until specialize() numbers them
+    std::vector<std::optional<List>> values;
+    std::size_t                      temps = 0;
+
+    Ref constant(float value) {
+        for (std::size_t i = 0; i < constants.size(); i++) {
+            if (std::memcmp(&constants[i], &value, sizeof(float)) == 0) {
+                return {Ref::Kind::Const, static_cast<std::uint16_t>(i)};
+            }
+        }
+        constants.push_back(value);
+        return {Ref::Kind::Const, static_cast<std::uint16_t>(constants.size() - 1)};
+    }
+    std::optional<float> constant_value(Ref ref) const {
+        if (ref.kind != Ref::Kind::Const) return std::nullopt;
+        return constants[ref.index];
+    }
+    std::optional<Ref> emit(Op op, Ref a, Ref b) {
+        if (slot_count + constants.size() + temps >= max_registers) return std::nullopt;
+        auto dst = static_cast<std::uint16_t>(temps++);
+        code.push_back({op, dst, encode(a), encode(b)});
+        return Ref{Ref::Kind::Temp, dst};
+    }
+    // For chaining: fails if an operand failed.
+    std::optional<Ref> emit(Op op, std::optional<Ref> a, std::optional<Ref> b) {
+        if (!a || !b) return std::nullopt;
+        return emit(op, *a, *b);
+    }
+    std::optional<Ref> emit_spline(Ref x, std::uint16_t spline) {
+        if (slot_count + constants.size() + temps >= max_registers) return std::nullopt;
+        auto dst = static_cast<std::uint16_t>(temps++);
+        code.push_back({Op::Spline, dst, encode(x), spline});
+        return Ref{Ref::Kind::Temp, dst};
+    }
+    // Operands are encoded as kind in the top two bits, so numbering can be finished in one pass later.
+    static std::uint16_t encode(Ref ref) {
+        return static_cast<std::uint16_t>((static_cast<unsigned>(ref.kind) << 14) | ref.index);
+    }
+
+    std::optional<List> elementwise(Op op, const List& a, const List& b) {
+        List res;
+        auto end = std::min(a.size(), b.size());
+        for (std::size_t i = 0; i < end; i++) {
+            auto r = emit(op, a[i], b[i]);
+            if (!r) return std::nullopt;
+            res.push_back(*r);
+        }
+        return res;
+    }
+    std::optional<List> fold(Op op, const List& list) {
+        if (list.empty()) return std::nullopt; // *max_element of an empty range
+        auto acc = list[0];
+        for (std::size_t i = 1; i < list.size(); i++) {
+            auto r = emit(op, acc, list[i]);
+            if (!r) return std::nullopt;
+            acc = *r;
+        }
+        return List{acc};
+    }
+    // Elementwise over the first `n` arguments up to the shortest, like builtins::call; `f(i)` emits the
+    // operations for element i.
+    template <typename F>
+    std::optional<List> map(const std::vector<const List*>& args, std::size_t n, F f) {
+        if (args.size() < n) return List{};
+        std::size_t size = std::numeric_limits<std::size_t>::max();
+        for (std::size_t i = 0; i < n; i++) size = std::min(size, args[i]->size());
+        List res;
+        for (std::size_t i = 0; i < size; i++) {
+            auto r = f(i);
+            if (!r) return std::nullopt;
+            res.push_back(*r);
+        }
+        return res;
+    }
+    // The points must be constants so their tables can be built now.
+    std::optional<List> spline(const std::vector<const List*>& args) {
+        if (args.empty()) return List{};
+        std::vector<float> points;
+        for (std::size_t i = 1; i < args.size(); i++) {
+            for (auto ref : *args[i]) {
+                auto value = constant_value(ref);
+                if (!value) return std::nullopt;
+                points.push_back(*value);
+            }
+        }
+        if (splines.size() >= std::numeric_limits<std::uint16_t>::max()) return std::nullopt;
+        splines.emplace_back(points);
+        auto index = static_cast<std::uint16_t>(splines.size() - 1);
+        return map(args, 1, [&](std::size_t i) { return emit_spline((*args[0])[i], index); });
+    }
+
+    // A loop's operations, element by element.
+    std::optional<List> loop(const bytecode::Loop& loop) {
+        std::vector<const List*> inputs;
+        auto                     size = std::numeric_limits<std::size_t>::max();
+        for (std::uint32_t i = 0; i < loop.count; i++) {
+            auto& value = values[source.operands[loop.first + i]];
+            if (!value) return std::nullopt;
+            inputs.push_back(&*value);
+            size = std::min(size, value->size());
+        }
+        constexpr Op ops[] = {Op::Add, Op::Sub, Op::Mul, Op::Div};
+        List         res;
+        List         operands(loop.count + loop.temps);
+        for (std::size_t i = 0; i < size; i++) {
+            for (std::uint32_t j = 0; j < loop.count; j++) operands[j] = (*inputs[j])[i];
+            for (auto& step : loop.code) {
+                auto op = ops[static_cast<int>(step.op) - static_cast<int>(bytecode::Op::Add)];
+                auto r  = emit(op, operands[step.a], operands[step.b]);
+                if (!r) return std::nullopt;
+                operands[loop.count + step.dst] = *r;
+            }
+            res.push_back(operands[loop.count + loop.code.back().dst]);
+        }
+        return res;
+    }
+
+    // Index arguments must be compile-time constants for the result to have a known length.
+    std::optional<std::size_t> count(const List& arg, std::size_t limit) const {
+        if (arg.empty()) return std::nullopt;
+        auto value = constant_value(arg[0]);
+        if (!value || !(*value >= 0.0f) || *value >= static_cast<float>(limit)) return std::nullopt;
+        return static_cast<std::size_t>(*value);
+    }
+
+    std::optional<List> call(const bytecode::Call& call) {
+        std::vector<const List*> args;
+        for (std::uint32_t i = 0; i < call.count; i++) {
+            auto& value = values[source.operands[call.first + i]];
+            if (!value) return std::nullopt;
+            args.push_back(&*value);
+        }
+        switch (call.builtin) {
+        case Builtin::Con: {
+            List res;
+            for (auto arg : args) res.insert(res.end(), arg->begin(), arg->end());
+            return res;
+        }
+        case Builtin::Max:
+            if (args.empty()) return std::nullopt;
+            return fold(Op::Max, *args[0]);
+        case Builtin::Min:
+            if (args.empty()) return std::nullopt;
+            return fold(Op::Min, *args[0]);
+        case Builtin::Sum: {
+            if (args.empty()) return std::nullopt;
+            auto acc = constant(0.0f);
+            for (auto ref : *args[0]) {
+                auto r = emit(Op::Add, acc, ref);
+                if (!r) return std::nullopt;
+                acc = *r;
+            }
+            return List{acc};
+        }
+        case Builtin::Len: {
+            List res;
+            for (auto arg : args) res.push_back(constant(static_cast<float>(arg->size())));
+            return res;
+        }
+        case Builtin::Of: {
+            if (args.size() < 2) return std::nullopt;
+            auto index = count(*args[0], args[1]->size());
+            if (!index) return std::nullopt;
+            return List{(*args[1])[*index]};
+        }
+        case Builtin::Tuple: {
+            if (args.empty()) return std::nullopt;
+            auto size = count(*args[0], max_registers);
+            if (!size) return std::nullopt;
+            auto fill = constant(0.0f);
+            if (args.size() >= 2) {
+                if (args[1]->empty()) return std::nullopt;
+                fill = (*args[1])[0];
+            }
+            return List(*size, fill);
+        }
+        case Builtin::Subtuple: {
+            // As in builtins::call, element i of t lands at position i of the b - a results and the
+            // positions before a or past t's end are 0.
+            if (args.size() < 3) return std::nullopt;
+            auto begin = count(*args[0], max_registers);
+            auto end   = count(*args[1], max_registers);
+            if (!begin || !end) return std::nullopt;
+            auto& t = *args[2];
+            List  res;
+            for (std::size_t i = 0; i + *begin < *end; i++) {
+                res.push_back(i >= *begin && i < t.size() ? t[i] : constant(0.0f));
+            }
+            return res;
+        }
+        case Builtin::Sort:
+            if (args.empty() || args[0]->size() > 1) return std::nullopt;
+            return *args[0];
+        case Builtin::Abs:
+        case Builtin::Sqrt:
+        case Builtin::Exp: {
+            auto op = call.builtin == Builtin::Abs ? Op::Abs : call.builtin == Builtin::Sqrt ? Op::Sqrt : Op::Exp;
+            return map(args, 1, [&](std::size_t i) { return emit(op, (*args[0])[i], (*args[0])[i]); });
+        }
+        // -0 - x is -x for every x, zeros included, so negation needs no op of its own.
+        case Builtin::Neg:
+            return map(args, 1, [&](std::size_t i) { return emit(Op::Sub, constant(-0.0f), (*args[0])[i]); });
+        case Builtin::Pow:
+            return map(args, 2, [&](std::size_t i) { return emit(Op::Pow, (*args[0])[i], (*args[1])[i]); });
+        // The rest expand to the operations builtins::clamp, lerp and smoothstep perform.
+        case Builtin::Clamp:
+            return map(args, 3, [&](std::size_t i) {
+                return emit(Op::Min, emit(Op::Max, (*args[0])[i], (*args[1])[i]), (*args[2])[i]);
+            });
+        case Builtin::Lerp:
+            return map(args, 3, [&](std::size_t i) {
+                auto a = (*args[0])[i], b = (*args[1])[i], t = (*args[2])[i];
+                return emit(Op::Add, a, emit(Op::Mul, t, emit(Op::Sub, b, a)));
+            });
+        case Builtin::Smoothstep:
+            return map(args, 3, [&](std::size_t i) {
+                auto edge0  = (*args[0])[i], edge1 = (*args[1])[i], x = (*args[2])[i];
+                auto scaled = emit(Op::Div, emit(Op::Sub, x, edge0), emit(Op::Sub, edge1, edge0));
+                auto t      = emit(Op::Min, emit(Op::Max, scaled, constant(0.0f)), constant(1.0f));
+                return emit(
+                    Op::Mul,
+                    emit(Op::Mul, t, t),
+                    emit(Op::Sub, constant(3.0f), emit(Op::Mul, constant(2.0f), t))
+                );
+            });
+        case Builtin::Spline:
+            return spline(args);
+        default:
+            return std::nullopt;
+        }
+    }
+
+    bool run() {
+        values.resize(source.registers);
+        for (auto& instr : source.code) {
+            std::optional<List> value;
+            switch (instr.op) {
+            case bytecode::Op::Const: {
+                List res;
+                for (auto v : source.constants[instr.a]) res.push_back(constant(v));
+                value = std::move(res);
+                break;
+            }
+            case bytecode::Op::Param:
+                value = List{
+                    Ref{Ref::Kind::Slot, instr.a}
+                };
+                break;
+            case bytecode::Op::Add:
+            case bytecode::Op::Sub:
+            case bytecode::Op::Mul:
+            case bytecode::Op::Div: {
+                auto& a = values[instr.a];
+                auto& b = values[instr.b];
+                if (!a || !b) return false;
+                constexpr Op ops[] = {Op::Add, Op::Sub, Op::Mul, Op::Div};
+                value = elementwise(ops[static_cast<int>(instr.op) - static_cast<int>(bytecode::Op::Add)], *a, *b);
+                break;
+            }
+            case bytecode::Op::Call:
+                value = call(source.calls[instr.a]);
+                break;
+            case bytecode::Op::Loop:
+                value = loop(source.loops[instr.a]);
+                break;
+            }
+            if (!value) return false;
+            values[instr.dst] = std::move(value);
+        }
+        return slot_count + constants.size() + temps <= max_registers;
+    }
+
+    std::uint16_t number(std::uint16_t encoded) const {
+        auto kind  = static_cast<Ref::Kind>(encoded >> 14);
+        auto index = static_cast<std::uint16_t>(encoded & 0x3fff);
+        switch (kind) {
+        case Ref::Kind::Slot:
+            return index;
+        case Ref::Kind::Const:
+            return static_cast<std::uint16_t>(slot_count + index);
+        default:
+            return static_cast<std::uint16_t>(slot_count + constants.size() + index);
+        }
+    }
+};
+} // namespace
+
+std::optional<Chunk> specialize(const bytecode::Chunk& chunk) {
+    Specializer specializer{chunk, {}, {}, {}, {}};
+    if (!specializer.run()) return std::nullopt;
+    Chunk res;
+    res.constants = specializer.constants;
+    res.splines   = std::move(specializer.splines);
+    res.registers = static_cast<std::uint16_t>(slot_count + specializer.constants.size() + specializer.temps);
+    for (auto instr : specializer.code) {
+        instr.a = specializer.number(instr.a);
+        if (reads_b(instr.op)) instr.b = specializer.number(instr.b);
+        instr.dst = specializer.number(Specializer::encode({Ref::Kind::Temp, instr.dst}));
+        res.code.push_back(instr);
+    }
+    for (auto ref : *specializer.values[chunk.result]) {
+        res.results.push_back(specializer.number(Specializer::encode(ref)));
+    }
+    return res;
+}
+
+std::optional<Chunk> fuse(std::span<const Chunk* const> chunks) {
+    if (chunks.empty() || chunks.size() > max_registers - slot_count) return std::nullopt;
+    Chunk res;
+    res.inputs = static_cast<std::uint16_t>(slot_count + chunks.size() - 1);
+    auto find  = [&](float v) {
+        return std::find_if(res.constants.begin(), res.constants.end(), [&](float x) {
+            return std::memcmp(&x, &v, sizeof(float)) == 0;
+        });
+    };
+    for (auto chunk : chunks) {
+        if (chunk->inputs != slot_count) return std::nullopt;
+        for (auto v : chunk->constants) {
+            if (find(v) == res.constants.end()) res.constants.push_back(v);
+        }
+    }
+    if (res.inputs + res.constants.size() > max_registers) return std::nullopt;
+    auto temp_base = static_cast<std::uint16_t>(res.inputs + res.constants.size());
+
+    // Value numbering over the concatenated code: an instruction whose op and operands were already
+    // seen reuses that register instead of being emitted again.
+    std::map<std::tuple<Op, std::uint16_t, std::uint16_t>, std::uint16_t> seen;
+    std::vector<Instr>                                                   code;
+    for (std::size_t k = 0; k < chunks.size(); k++) {
+        auto&                      chunk       = *chunks[k];
+        auto                       spline_base = res.splines.size();
+        std::vector<std::uint16_t> number(chunk.registers);
+        if (spline_base + chunk.splines.size() > std::numeric_limits<std::uint16_t>::max()) return std::nullopt;
+        res.splines.insert(res.splines.end(), chunk.splines.begin(), chunk.splines.end());
+        for (std::uint16_t r = 0; r < slot_count; r++) number[r] = r;
+        if (k > 0) number[static_cast<std::size_t>(Slot::Ori)] = static_cast<std::uint16_t>(slot_count + k - 1);
+        for (std::size_t i = 0; i < chunk.constants.size(); i++) {
+            auto index             = find(chunk.constants[i]) - res.constants.begin();
+            number[slot_count + i] = static_cast<std::uint16_t>(res.inputs + index);
+        }
+        for (auto instr : chunk.code) {
+            instr.a = number[instr.a];
+            instr.b = reads_b(instr.op) ? number[instr.b] : static_cast<std::uint16_t>(spline_base + instr.b);
+            auto [it, inserted] = seen.try_emplace({instr.op, instr.a, instr.b}, 0);
+            if (inserted) {
+                if (temp_base + code.size() >= std::numeric_limits<std::uint16_t>::max()) return std::nullopt;
+                it->second = static_cast<std::uint16_t>(temp_base + code.size());
+                code.push_back({instr.op, it->second, instr.a, instr.b});
+            }
+            number[instr.dst] = it->second;
+        }
+        auto first = chunk.results.empty() ? static_cast<std::uint16_t>(Slot::Ori) : chunk.results[0];
+        res.results.push_back(number[first]);
+    }
+
+    // Only the first value of each chunk is kept, so whatever computed the rest is dropped.
+    std::vector<bool> live(temp_base + code.size(), false);
+    for (auto reg : res.results) live[reg] = true;
+    for (auto i = code.size(); i-- > 0;) {
+        if (!live[code[i].dst]) continue;
+        live[code[i].a] = true;
+        if (reads_b(code[i].op)) live[code[i].b] = true;
+    }
+    std::vector<std::uint16_t> number(live.size());
+    for (std::uint16_t r = 0; r < temp_base; r++) number[r] = r;
+    res.registers = temp_base;
+    for (auto instr : code) {
+        if (!live[instr.dst]) continue;
+        number[instr.dst] = res.registers++;
+        auto b            = reads_b(instr.op) ? number[instr.b] : instr.b;
+        res.code.push_back({instr.op, number[instr.dst], number[instr.a], b});
+    }
+    for (auto& reg : res.results) reg = number[reg];
+    if (res.registers > max_registers) return std::nullopt;
+    return res;
+}
+
+void execute(const Chunk& chunk, float* registers) {
+    std::copy(chunk.constants.begin(), chunk.constants.end(), registers + chunk.inputs);
+    for (auto& instr : chunk.code) {
+        auto  a   = registers[instr.a];
+        auto& dst = registers[instr.dst];
+        switch (instr.op) {
+        case Op::Add:
+            dst = a + registers[instr.b];
+            break;
+        case Op::Sub:
+            dst = a - registers[instr.b];
+            break;
+        case Op::Mul:
+            dst = a * registers[instr.b];
+            break;
+        case Op::Div:
+            dst = a / registers[instr.b];
+            break;
+        case Op::Max: {
+            auto b = registers[instr.b];
+            dst    = a < b ? b : a;
+            break;
+        }
+        case Op::Min: {
+            auto b = registers[instr.b];
+            dst    = b < a ? b : a;
+            break;
+        }
+        case Op::Pow:
+            dst = std::pow(a, registers[instr.b]);
+            break;
+        case Op::Abs:
+            dst = std::fabs(a);
+            break;
+        case Op::Sqrt:
+            dst = std::sqrt(a);
+            break;
+        case Op::Exp:
+            dst = std::exp(a);
+            break;
+        case Op::Spline:
+            dst = chunk.splines[instr.b](a);
+            break;
+        }
+    }
+}
+} // namespace expr::scalar
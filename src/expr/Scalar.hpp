@@ -0,0 +1,76 @@
+#pragma once
+#include "Bytecode.hpp"
+#include "Expr.hpp"
+#include "Spline.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace expr::scalar {
+enum class Op : std::uint8_t {
+    Add, // dst = a + b
+    Sub,
+    Mul,
+    Div,
+    Max, // dst = a < b ? b : a, the step std::max_element takes
+    Min, // dst = b < a ? b : a, the step std::min_element takes
+    Pow, // dst = std::pow(a, b)
+    // Unary ops repeat `a` in `b`.
+    Abs,
+    Sqrt,
+    Exp,
+    Spline, // dst = splines[b](a)
+};
+
+/// Whether `b` names a register. Spline keeps an index into Chunk::splines there instead.
+inline bool reads_b(Op op) { return op != Op::Spline; }
+
+struct Instr {
+    Op            op;
+    std::uint16_t dst;
+    std::uint16_t a;
+    std::uint16_t b;
+};
+
+/// Register file size of the float-only evaluator. Programs needing more stay on the tuple path.
+inline constexpr std::size_t max_registers = 256;
+
+/// A program in which every value has a length known at compile time, flattened to single floats.
+/// Registers [0, inputs) hold the parameters and the next `constants.size()` hold the constants.
+struct Chunk {
+    std::vector<float>         constants;
+    std::vector<Spline>        splines;
+    std::vector<Instr>         code;
+    std::vector<std::uint16_t> results;
+    std::uint16_t              registers = 0;
+    std::uint16_t              inputs    = static_cast<std::uint16_t>(Slot::Count);
+};
+
+/// Returns the float-only form of `chunk`, or std::nullopt if some value can't be proven to have a
+/// fixed length or a call has effects (`push`, `pop`, user functions) the evaluator can't reproduce.
+std::optional<Chunk> specialize(const bytecode::Chunk& chunk);
+
+/// Merges chunks into one that computes repeated values once. Its inputs are the slots of chunks[0]
+/// followed by the `ori` of chunks[1..]; results[i] is the first value of chunks[i], or chunk i's `ori`
+/// if that value is empty. Returns std::nullopt if the merged chunk needs too many registers.
+std::optional<Chunk> fuse(std::span<const Chunk* const> chunks);
+
+/// Runs `chunk` once the caller has stored its inputs in registers [0, chunk.inputs).
+void execute(const Chunk& chunk, float* registers);
+
+/// Runs `chunk` with the register file on the stack; never allocates.
+inline void run(const Chunk& chunk, const Slots& slots, float* registers) {
+    std::copy(slots.begin(), slots.end(), registers);
+    execute(chunk, registers);
+}
+
+inline float run_first(const Chunk& chunk, const Slots& slots, float fallback) {
+    float registers[max_registers];
+    run(chunk, slots, registers);
+    return chunk.results.empty() ? fallback : registers[chunk.results[0]];
+}
+} // namespace expr::scalar
@@ -0,0 +1,75 @@
+#include "Spline.hpp"
+
+#include <algorithm>
+
+namespace expr {
+namespace {
+// Mojang's Mth.lerp argument order.
+float lerp(float t, float a, float b) { return a + t * (b - a); }
+
+// The segment between (x0, y0, d0) and (x1, y1, d1); both Spline and spline() go through here, so the
+// precomputed and the direct form round identically.
+struct Cubic {
+    float width, p, q;
+};
+Cubic cubic(float x0, float y0, float d0, float x1, float y1, float d1) {
+    auto width = x1 - x0;
+    return {width, d0 * width - (y1 - y0), -d1 * width + (y1 - y0)};
+}
+
+float segment(float x, float x0, float y0, float y1, const Cubic& cubic) {
+    auto t = (x - x0) / cubic.width;
+    return lerp(t, y0, y1) + t * (1.0f - t) * lerp(t, cubic.p, cubic.q);
+}
+
+float line(float x, float location, float value, float derivative) { return value + derivative * (x - location); }
+} // namespace
+
+Spline::Spline(std::span<const float> points) {
+    auto count = points.size() / 3;
+    if (count == 0) return;
+    mPoints.assign(points.begin(), points.begin() + static_cast<std::ptrdiff_t>(3 * count));
+    auto point = [&](std::size_t i) { return points.subspan(3 * i, 3); };
+    for (std::size_t i = 0; i < count; i++) mLocations.push_back(point(i)[0]);
+    for (std::size_t i = 0; i + 1 < count; i++) {
+        auto a = point(i), b = point(i + 1);
+        auto c = cubic(a[0], a[1], a[2], b[0], b[1], b[2]);
+        mSegments.push_back({a[0], c.width, a[1], b[1], c.p, c.q});
+    }
+    mFirstValue      = point(0)[1];
+    mFirstDerivative = point(0)[2];
+    mLastValue       = point(count - 1)[1];
+    mLastDerivative  = point(count - 1)[2];
+}
+
+float Spline::operator()(float x) const {
+    if (mLocations.empty()) return 0.0f;
+    // The last location not above x; NaN compares false everywhere and lands past the end.
+    auto i = std::upper_bound(mLocations.begin(), mLocations.end(), x) - mLocations.begin();
+    if (i == 0) return line(x, mLocations.front(), mFirstValue, mFirstDerivative);
+    if (static_cast<std::size_t>(i) == mLocations.size()) {
+        return line(x, mLocations.back(), mLastValue, mLastDerivative);
+    }
+    auto& s = mSegments[static_cast<std::size_t>(i) - 1];
+    return segment(x, s.x0, s.y0, s.y1, {s.width, s.p, s.q});
+}
+
+float spline(std::span<const float> points, float x) {
+    auto count = points.size() / 3;
+    if (count == 0) return 0.0f;
+    // Binary search for the first location above x, as std::upper_bound over every third element.
+    std::size_t lo = 0, hi = count;
+    while (lo < hi) {
+        auto mid = lo + (hi - lo) / 2;
+        if (x < points[3 * mid]) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    if (lo == 0) return line(x, points[0], points[1], points[2]);
+    if (lo == count) return line(x, points[3 * count - 3], points[3 * count - 2], points[3 * count - 1]);
+    auto a = points.subspan(3 * (lo - 1), 3), b = points.subspan(3 * lo, 3);
+    return segment(x, a[0], a[1], b[1], cubic(a[0], a[1], a[2], b[0], b[1], b[2]));
+}
+} // namespace expr
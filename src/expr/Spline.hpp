@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace expr {
+/// A piecewise cubic through (location, value, derivative) points, evaluated the way the vanilla
+/// terrain splines are: Hermite segments between points, and straight lines along the end derivatives
+/// outside them. Locations are expected to increase; NaN evaluates the last line and so gives NaN.
+class Spline {
+public:
+    Spline() = default;
+    /// `points` is a flat list of (location, value, derivative) triples; a trailing partial triple is
+    /// ignored. Everything that doesn't depend on x is computed here.
+    explicit Spline(std::span<const float> points);
+
+    /// Same bits as expr::spline() on the points this was built from.
+    [[nodiscard]] float operator()(float x) const;
+
+    /// The whole triples of the points this was built from, to build it again elsewhere.
+    [[nodiscard]] const std::vector<float>& points() const { return mPoints; }
+
+    bool operator==(const Spline&) const = default;
+
+private:
+    struct Segment {
+        float x0, width, y0, y1, p, q;
+
+        bool operator==(const Segment&) const = default;
+    };
+
+    std::vector<float>   mPoints;
+    std::vector<float>   mLocations;
+    std::vector<Segment> mSegments; // between consecutive locations
+    float                mFirstValue = 0, mFirstDerivative = 0;
+    float                mLastValue = 0, mLastDerivative = 0;
+};
+
+/// Evaluates the spline through `points` (as in Spline::Spline) at x without building tables, for
+/// points only known at run time. No points give 0.
+float spline(std::span<const float> points, float x);
+} // namespace expr
@@ -0,0 +1,46 @@
+#pragma once
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <span>
+
+// Comparing code generated from a program with the interpreter, shared by the JIT, climate_codegen and the
+// tests.
+namespace expr::verify {
+/// Whether two results agree bit for bit. NaN payloads depend on operand order, which the interpreter
+/// leaves to the C++ compiler, so any two NaNs agree.
+inline bool same(float a, float b) {
+    return std::bit_cast<std::uint32_t>(a) == std::bit_cast<std::uint32_t>(b) || (std::isnan(a) && std::isnan(b));
+}
+
+/// Inputs where implementations tend to differ: signed zeros, infinities, NaN and denormals.
+inline constexpr float special[] = {
+    0.0f,
+    -0.0f,
+    1.0f,
+    -1.0f,
+    std::numeric_limits<float>::infinity(),
+    -std::numeric_limits<float>::infinity(),
+    std::numeric_limits<float>::quiet_NaN(),
+    std::numeric_limits<float>::denorm_min(),
+};
+
+/// Fills `inputs` with values in [-2, 2], mixing in special values every other round, and calls `check`
+/// `rounds` times. Returns false as soon as `check` does. The sequence is the same on every call.
+template <class Check>
+bool sample(int rounds, std::span<float> inputs, Check&& check) {
+    std::mt19937                          rng(0x5eed);
+    std::uniform_real_distribution<float> value(-2.0f, 2.0f);
+    std::uniform_int_distribution<int>    pick(0, 15);
+    for (int round = 0; round < rounds; round++) {
+        for (auto& input : inputs) {
+            auto k = pick(rng);
+            input  = k < static_cast<int>(std::size(special)) && round % 2 ? special[k] : value(rng);
+        }
+        if (!check()) return false;
+    }
+    return true;
+}
+} // namespace expr::verify
@@ -0,0 +1,119 @@
+// Checks the JIT against the interpreters: every formula of the corpus, including those that call out to
+// pow, exp and splines, must compile to native code and give the same bits as the bytecode interpreter
+// and the tree walker on random and special inputs, alone and fused.
+//
+// Usage: jit_test
+
+#include "expr/Expr.hpp"
+#include "expr/Jit.hpp"
+#include "expr/Verify.hpp"
+
+#include <array>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+constexpr const char* corpus[] = {
+    "ori*1.25;",
+    "ori+continentalness*0.1-0.05;",
+    "(ori*3+continentalness+erosion)/(4+weirdness*weirdness);",
+    "max(con(ori,weirdness*0.3,0-erosion*0.2))*1.1;",
+    "min(con(ori,continentalness))-max(con(erosion,0));",
+    "sum(con(ori,erosion,weirdness)*tuple(3,0.3333));",
+    "abs(ori)+sqrt(abs(continentalness))-clamp(erosion,-0.5,0.5);",
+    "lerp(ori,continentalness,smoothstep(-1,1,weirdness));",
+    "pow(abs(ori),1.5)+pow(continentalness,erosion);",
+    "exp(ori)*exp(0-weirdness*weirdness);",
+    "spline(continentalness,-1.1,0.044,0,-0.19,-0.12,0,0.3,0.2,1)*ori;",
+    "spline(erosion,-1,1,0,0,0.5,2,1,-1,0)+spline(weirdness,-0.5,0,1,0.5,1,-1)*pow(abs(ori),erosion)+exp(ori);",
+    "h=clamp(erosion*2,0,1);ori*(1-h)+spline(continentalness,-1,0,1,1,1,0)*h;",
+};
+
+constexpr int rounds = 20000;
+
+int failures = 0;
+
+bool agree(const expr::Program& jit, const expr::Program& bytecode, const expr::Program& tree, const expr::Slots& s) {
+    auto expected = bytecode.evalFirst(s, s[0]);
+    return expr::verify::same(jit.evalFirst(s, s[0]), expected)
+        && expr::verify::same(tree.evalFirst(s, s[0]), expected);
+}
+} // namespace
+
+int main() {
+    if (!expr::jit::supported()) {
+        std::printf("the JIT doesn't support this platform\n");
+        return 0;
+    }
+
+    std::vector<expr::Program> programs;
+    for (auto formula : corpus) {
+        auto program = expr::compile(formula);
+        if (!program) {
+            std::fprintf(stderr, "\"%s\" doesn't compile\n", formula);
+            return 1;
+        }
+        auto jit = *program, tree = *program;
+        jit.setBackend(expr::Backend::Jit);
+        tree.setBackend(expr::Backend::Tree);
+        programs.push_back(jit);
+        // compile() falls back to the interpreter if the code it generated disagrees with it.
+        if (!jit.isNative()) {
+            std::fprintf(stderr, "\"%s\" wasn't compiled to native code\n", formula);
+            failures++;
+            continue;
+        }
+
+        expr::Slots slots;
+        auto        check = [&] { return agree(jit, *program, tree, slots); };
+        // The shared sampler mixes in special values; a wider range reaches exp overflow and large powers.
+        bool                                  ok = expr::verify::sample(rounds, slots, check);
+        std::mt19937                          rng(7);
+        std::uniform_real_distribution<float> wide(-100.0f, 100.0f);
+        for (int round = 0; ok && round < rounds; round++) {
+            for (auto& slot : slots) slot = wide(rng);
+            ok = check();
+        }
+        if (!ok) {
+            std::fprintf(
+                stderr,
+                "\"%s\" differs at (%g, %g, %g, %g)\n",
+                formula,
+                slots[0],
+                slots[1],
+                slots[2],
+                slots[3]
+            );
+            failures++;
+        }
+    }
+
+    // Consecutive triples fused the way the hooks fuse factor, jaggedness and offset.
+    for (std::size_t i = 0; i + 3 <= programs.size(); i += 3) {
+        auto fused = expr::fuse(std::span(programs).subspan(i, 3));
+        if (!fused) {
+            std::fprintf(stderr, "formulas %zu..%zu don't fuse\n", i, i + 2);
+            failures++;
+            continue;
+        }
+        expr::Slots slots;
+        bool        ok = expr::verify::sample(rounds, slots, [&] {
+            std::array<float, 3> out;
+            std::array           ori{slots[0], slots[0], slots[0]};
+            fused->evalFirst(ori, slots[1], slots[2], slots[3], out);
+            for (std::size_t j = 0; j < 3; j++) {
+                if (!expr::verify::same(out[j], programs[i + j].evalFirst(slots, slots[0]))) return false;
+            }
+            return true;
+        });
+        if (!ok) {
+            std::fprintf(stderr, "formulas %zu..%zu differ when fused\n", i, i + 2);
+            failures++;
+        }
+    }
+
+    if (failures) return 1;
+    std::printf("%zu formulas match the interpreters on native code\n", programs.size());
+    return 0;
+}
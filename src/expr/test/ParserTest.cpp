@@ -0,0 +1,100 @@
+// Checks that malformed formulas and definitions are rejected with the expected message and position, and
+// that input too deep to lower or walk without overflowing the stack is rejected rather than crashing.
+//
+// Usage: expr_parser_test
+
+#include "expr/Expr.hpp"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+struct Case {
+    std::string code;
+    std::string error;
+};
+
+std::string repeat(const std::string& text, std::size_t count) {
+    std::string res;
+    for (std::size_t i = 0; i < count; i++) res += text;
+    return res;
+}
+
+const Case formulas[] = {
+    {"(ori;", "expected ')', found ';' at column 5"},
+    {"ori);", "expected ';', found ')' at column 4"},
+    {"ori*;", "expected a value, found ';' at column 5"},
+    {"ori+*2;", "expected a value, found '*' at column 5"},
+    {"max(1,;", "expected a value, found ';' at column 7"},
+    {"con(1 2);", "expected ',' or ')', found '2' at column 7"},
+    {"1.2.3;", "invalid number '1.2.3' at column 1"},
+    {"1e99;", "number '1e99' is out of range at column 1"},
+    {"ori; ori", "expected ';', found end of input at column 9"},
+    {"ori;)", "expected a value, found ')' at column 5"},
+    {"ori # 2;", "unexpected character '#' at column 5"},
+    {"ori\n+ $;", "unexpected character '$' at line 2, column 3"},
+    {"", "expected at least one statement ending in ';'"},
+    {";", "empty statement at column 1"},
+    {"x=;", "missing value after '=' at column 3"},
+    {"ori=1;", "cannot assign to parameter 'ori' at column 1"},
+    {"bar;", "unknown parameter 'bar' at column 1"},
+    {"foo(1);", "unknown function 'foo' at column 1"},
+    {repeat("(", 300) + "ori" + repeat(")", 300) + ";", "expression nested too deeply at column 258"},
+    // Chains of binary operators recurse in lowering and the tree walker, not in the parser.
+    {"ori" + repeat("+weirdness", 60000) + ";", "expression too long or nested too deeply at column 20474"},
+    {"ori" + repeat("*weirdness", 2000) + repeat("-ori", 100) + ";",
+     "expression too long or nested too deeply at column 20192"},
+};
+
+const Case definitions[] = {
+    {"f(x) = x + y;", "unknown parameter 'y' at column 12"},
+    {"f(x, x) = x;", "duplicate parameter 'x' at column 6"},
+    {"f(x) = x; f(y) = y;", "'f' is already defined at column 11"},
+    {"f(x) = x", "expected ';', found end of input at column 9"},
+};
+
+int failures = 0;
+
+void check(const char* kind, const Case& c, bool compiled, const std::string& error) {
+    if (!compiled && error == c.error) return;
+    auto shown = c.code.size() > 40 ? c.code.substr(0, 40) + "..." : c.code;
+    std::fprintf(
+        stderr,
+        "%s \"%s\": expected \"%s\", got \"%s\"\n",
+        kind,
+        shown.c_str(),
+        c.error.c_str(),
+        compiled ? "no error" : error.c_str()
+    );
+    failures++;
+}
+} // namespace
+
+int main() {
+    for (auto& c : formulas) {
+        std::string error;
+        auto        program = expr::compile(c.code, {}, &error);
+        check("formula", c, program.has_value(), error);
+    }
+    for (auto& c : definitions) {
+        std::string error;
+        auto        defined = expr::define(c.code, {}, &error);
+        check("definitions", c, defined.has_value(), error);
+    }
+
+    // Just within the limits.
+    for (auto code : {
+             "ori" + repeat("+weirdness", 2000) + ";",
+             repeat("(", 250) + "ori" + repeat(")", 250) + ";",
+         }) {
+        std::string error;
+        if (!expr::compile(code, {}, &error)) {
+            std::fprintf(stderr, "a formula within the limits doesn't compile: %s\n", error.c_str());
+            failures++;
+        }
+    }
+
+    if (failures) return 1;
+    std::printf("malformed formulas are rejected as expected\n");
+    return 0;
+}
@@ -0,0 +1,115 @@
+// Evaluates programs shared by many threads, each through its own EvalContext::local(), and checks every
+// result against the same evaluations done on one thread first: contexts must not leak state between
+// threads, including the push/pop stack and the scratch arena the tuples live in.
+//
+// Usage: expr_threads_test [threads]
+
+#include "expr/Expr.hpp"
+#include "expr/Verify.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr const char* formulas[] = {
+    "push(ori*2);push(continentalness);pop()+pop()*0.5;",
+    "push(con(ori,erosion,weirdness));push(sort(pop()));of(1,pop())+len(pop());",
+    "push(erosion);push(weirdness);max(con(pop(),pop(),ori));",
+    "of(1,sort(con(ori,erosion,weirdness)));",
+    "sum(con(ori,erosion,weirdness)*tuple(3,0.3333));",
+    "t=sort(con(ori,continentalness,erosion,weirdness));subtuple(t,1,3)*ori+con(len(t));",
+    "con(ori,erosion)*weirdness+tuple(2,continentalness);",
+    "max(con(ori,weirdness*0.3,0-erosion*0.2))*1.1;",
+};
+
+constexpr expr::Backend backends[] = {expr::Backend::Tree, expr::Backend::Bytecode, expr::Backend::Jit};
+constexpr const char*   backend_names[] = {"tree", "bytecode", "jit"};
+
+constexpr std::size_t samples = 2000;
+constexpr int         rounds  = 20;
+
+// One evaluation: the whole value and evalFirst()'s result.
+struct Result {
+    std::vector<float> value;
+    float              first;
+};
+
+bool same(const Result& a, const Result& b) {
+    return a.value.size() == b.value.size()
+        && std::equal(a.value.begin(), a.value.end(), b.value.begin(), expr::verify::same)
+        && expr::verify::same(a.first, b.first);
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    unsigned threads = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 0;
+    if (threads == 0) threads = std::max(4u, std::thread::hardware_concurrency());
+
+    std::vector<expr::Program> programs;
+    for (auto formula : formulas) {
+        auto program = expr::compile(formula);
+        if (!program) {
+            std::fprintf(stderr, "\"%s\" doesn't compile\n", formula);
+            return 1;
+        }
+        for (auto backend : backends) {
+            programs.push_back(*program);
+            programs.back().setBackend(backend);
+        }
+    }
+
+    std::mt19937                          rng(42);
+    std::uniform_real_distribution<float> value(-1.2f, 1.2f);
+    std::vector<expr::Slots>              inputs(samples);
+    for (auto& slots : inputs) {
+        for (auto& slot : slots) slot = value(rng);
+    }
+
+    // reference[p * samples + s] is program p on sample s.
+    std::vector<Result> reference;
+    for (auto& program : programs) {
+        for (auto& slots : inputs) reference.push_back({program.eval(slots), program.evalFirst(slots, slots[0])});
+    }
+
+    std::atomic<int>         failures{0};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            for (int round = 0; round < rounds && failures.load(std::memory_order_relaxed) == 0; round++) {
+                // Each thread walks the samples from its own offset, interleaving all programs, so threads
+                // run different programs on different inputs at the same moment.
+                for (std::size_t i = 0; i < samples; i++) {
+                    auto s = (i + t * 97) % samples;
+                    for (std::size_t p = 0; p < programs.size(); p++) {
+                        auto&  slots = inputs[s];
+                        Result res{programs[p].eval(slots), programs[p].evalFirst(slots, slots[0])};
+                        if (same(res, reference[p * samples + s])) continue;
+                        if (failures.fetch_add(1) == 0) {
+                            std::fprintf(
+                                stderr,
+                                "\"%s\" on %s differs on thread %u at (%g, %g, %g, %g)\n",
+                                formulas[p / std::size(backends)],
+                                backend_names[p % std::size(backends)],
+                                t,
+                                slots[0],
+                                slots[1],
+                                slots[2],
+                                slots[3]
+                            );
+                        }
+                        return;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    if (failures) return 1;
+    std::printf("%zu programs on %u threads match the single-threaded results\n", programs.size(), threads);
+    return 0;
+}
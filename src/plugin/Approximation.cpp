@@ -0,0 +1,84 @@
+#include "Approximation.hpp"
+#include "OverworldClimateModify.h"
+
+#include <chrono>
+#include <vector>
+
+namespace climate_modify_config {
+namespace {
+// 257^3 floats is 68 MB per formula, which is already far more than interpolation needs.
+constexpr int max_resolution = 257;
+} // namespace
+
+bool Approximation::build(
+    Entry&                                           entry,
+    const expr::Program&                             program,
+    const std::function<float(float, float, float)>& vanilla
+) {
+    auto& logger = overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger();
+    auto  begin  = std::chrono::steady_clock::now();
+
+    auto points = static_cast<std::size_t>(mConfig.resolution);
+    auto axis   = [&](const Config::Range& range) { return expr::LookupTable::Axis{range.min, range.max, points}; };
+    std::array<expr::LookupTable::Axis, 3> axes{
+        axis(mConfig.continentalness),
+        axis(mConfig.erosion),
+        axis(mConfig.weirdness),
+    };
+    for (auto& a : axes) {
+        if (mConfig.resolution < 2 || mConfig.resolution > max_resolution || !(a.min < a.max)) {
+            logger.warn(
+                "Lookup table for {} needs a non-empty range and 2 to {} points per axis, not using it",
+                mName,
+                max_resolution
+            );
+            return false;
+        }
+    }
+
+    // Vanilla values first, if the formula reads them, then the formula over the whole grid in one batch.
+    auto&              inputs       = program.inputs();
+    auto               needsVanilla = inputs.slots[static_cast<std::size_t>(expr::Slot::Ori)] || inputs.fallback;
+    std::vector<float> ori;
+    auto               exact =
+        [&](std::span<const float> c, std::span<const float> e, std::span<const float> w, std::span<float> out) {
+            ori.assign(c.size(), 0.0f);
+            if (needsVanilla) {
+                for (std::size_t i = 0; i < c.size(); i++) ori[i] = vanilla(c[i], e[i], w[i]);
+            }
+            program.evalBatch(ori, c, e, w, out);
+        };
+    auto& table = entry.table;
+    table       = expr::LookupTable::build(axes, exact);
+    auto error  = table.measure(exact);
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    logger.info(
+        "Lookup table for {}: {} points in {:.1f} ms, max error {}, mean error {}",
+        mName,
+        table.size(),
+        elapsed,
+        error.max,
+        error.mean
+    );
+    if (!(error.max <= mConfig.tolerance)) {
+        logger.warn(
+            "Lookup table for {} exceeds the tolerance of {}, evaluating the formula exactly instead",
+            mName,
+            mConfig.tolerance
+        );
+        table = {};
+        return false;
+    }
+    return true;
+}
+
+void Approximation::warnFull() {
+    if (mFull.exchange(true)) return;
+    overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger().warn(
+        "Lookup tables for {} are in use for {} terrain shapers already, evaluating it exactly for the others",
+        mName,
+        max_shapers
+    );
+}
+} // namespace climate_modify_config
@@ -0,0 +1,69 @@
+#pragma once
+#include "ClimateModifyConfig.hpp"
+#include "expr/Expr.hpp"
+#include "expr/LookupTable.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+
+namespace climate_modify_config {
+/// Lookup tables standing in for one formula, one per TerrainShaper since each has its own vanilla values.
+/// A table is built on the first hook call for its shaper because every grid point needs the vanilla
+/// value, which is only available through the hook's `origin`.
+class Approximation {
+public:
+    Approximation(std::string name, const Config::LookupTable& config) : mName(std::move(name)), mConfig(config) {}
+
+    /// Returns the table for `shaper`, or nullptr while it is being built, if it was rejected or if
+    /// `max_shapers` other shapers already have one. Only the first caller builds; concurrent callers keep
+    /// evaluating exactly instead of waiting.
+    template <typename Vanilla>
+    const expr::LookupTable* get(const expr::Program& program, const void* shaper, const Vanilla& vanilla) {
+        auto entry = find(shaper);
+        if (!entry) {
+            if (!mFull.load(std::memory_order_relaxed)) warnFull();
+            return nullptr;
+        }
+        auto state = entry->state.load(std::memory_order_acquire);
+        if (state == State::Pending && entry->state.compare_exchange_strong(state, State::Building)) {
+            state = build(*entry, program, vanilla) ? State::Ready : State::Rejected;
+            entry->state.store(state, std::memory_order_release);
+        }
+        return state == State::Ready ? &entry->table : nullptr;
+    }
+
+private:
+    // Worldgen has one shaper per dimension; more than this and the rest are evaluated exactly.
+    static constexpr std::size_t max_shapers = 4;
+
+    enum class State : std::uint8_t { Pending, Building, Ready, Rejected };
+
+    struct Entry {
+        std::atomic<const void*> shaper{nullptr}; // claimed once, never released
+        std::atomic<State>       state{State::Pending};
+        expr::LookupTable        table;
+    };
+
+    Entry* find(const void* shaper) {
+        for (auto& entry : mEntries) {
+            const void* owner = entry.shaper.load(std::memory_order_acquire);
+            if (!owner && entry.shaper.compare_exchange_strong(owner, shaper)) return &entry;
+            if (owner == shaper) return &entry;
+        }
+        return nullptr;
+    }
+
+    bool build(Entry& entry, const expr::Program& program, const std::function<float(float, float, float)>& vanilla);
+    void warnFull();
+
+    std::string                    mName;
+    Config::LookupTable            mConfig;
+    std::array<Entry, max_shapers> mEntries;
+    std::atomic<bool>              mFull{false}; // set once a shaper found no free entry, so it is logged once
+};
+} // namespace climate_modify_config
@@ -1,26 +1,184 @@
 #include "ClimateModifyConfig.hpp"
+#include "Approximation.hpp"
 #include "OverworldClimateModify.h"
 
 #include "ll/api/Config.h"
 
-climate_modify_config::Config climate_modify_config::Config::instance() {
-    static climate_modify_config::Config config;
-    static bool                          loaded = false;
-    if (loaded) return config;
-    if (!std::filesystem::exists(overworld_climate_modify::OverworldClimateModify::getInstance().getConfigFilePath())) {
-        std::filesystem::create_directories(
-            overworld_climate_modify::OverworldClimateModify::getInstance().getConfigDirPath()
-        );
-        ll::config::saveConfig(
-            config,
-            overworld_climate_modify::OverworldClimateModify::getInstance().getConfigFilePath()
-        );
-    } else {
-        ll::config::loadConfig(
-            config,
-            overworld_climate_modify::OverworldClimateModify::getInstance().getConfigFilePath()
-        );
+#include <array>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+const climate_modify_config::Config& climate_modify_config::Config::instance() {
+    static const climate_modify_config::Config config = [] {
+        auto& plugin = overworld_climate_modify::OverworldClimateModify::getInstance();
+
+        climate_modify_config::Config res;
+        if (!std::filesystem::exists(plugin.getConfigFilePath())) {
+            std::filesystem::create_directories(plugin.getConfigDirPath());
+            ll::config::saveConfig(res, plugin.getConfigFilePath());
+        } else {
+            ll::config::loadConfig(res, plugin.getConfigFilePath());
+        }
+        return res;
+    }();
+    return config;
+}
+
+std::optional<climate_modify_config::Config> climate_modify_config::Config::reload(std::string* error) {
+    auto          path = overworld_climate_modify::OverworldClimateModify::getInstance().getConfigFilePath();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        if (error) *error = "can't read " + path.string();
+        return std::nullopt;
+    }
+    std::string content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    // loadConfig replaces a file it can't parse with the defaults, which would throw away an edit that is
+    // merely unfinished, so check first.
+    if (nlohmann::ordered_json::parse(content, nullptr, false, true).is_discarded()) {
+        if (error) *error = path.string() + " is not valid JSON";
+        return std::nullopt;
     }
-    loaded = true;
+    climate_modify_config::Config config;
+    ll::config::loadConfig(config, path);
     return config;
-}
\ No newline at end of file
+}
+
+namespace climate_modify_config {
+namespace {
+// `info` tags its output with the formula, or "functions" for the definitions, it was called from.
+expr::FunctionTable builtin_functions(const std::string& name) {
+    return {
+        {"info", [name](const std::vector<std::vector<float>>& args) {
+             for (auto i : args[0]) {
+                 overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger().info(
+                     "{}:{}",
+                     name,
+                     i
+                 );
+             }
+             return args[0];
+         }}
+    };
+}
+
+// Logs the error and returns nullopt if the definitions don't parse.
+std::optional<expr::Definitions> define_functions(const std::string& code) {
+    auto&       logger = overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger();
+    std::string error;
+    auto        definitions = expr::define(code, builtin_functions("functions"), &error);
+    if (!definitions) logger.error("Failed to parse functions \"{}\": {}", code, error);
+    return definitions;
+}
+
+// Logs the error and returns nullopt if `code` doesn't compile.
+std::optional<expr::Program>
+compile_formula(const std::string& name, const std::string& code, const expr::Definitions& definitions) {
+    auto&       logger = overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger();
+    std::string error;
+    auto        program = expr::compile(code, builtin_functions(name), &error, definitions);
+    if (!program) logger.error("Failed to compile {} formula \"{}\": {}", name, code, error);
+    return program;
+}
+
+expr::Program
+compile_or_identity(const std::string& name, const std::string& code, const expr::Definitions& definitions) {
+    if (auto program = compile_formula(name, code, definitions)) return std::move(*program);
+    overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger().error(
+        "Falling back to the vanilla {}",
+        name
+    );
+    return *expr::compile("ori;");
+}
+
+// Applies the backend, fusion and lookup table settings to freshly compiled formulas.
+Programs configure(Programs programs, const Config& config) {
+    auto& logger  = overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger();
+    auto  backend = expr::Backend::Bytecode;
+    if (config.backend == "tree") {
+        backend = expr::Backend::Tree;
+    } else if (config.backend == "jit") {
+        backend = expr::Backend::Jit;
+    } else if (config.backend != "bytecode") {
+        logger.warn("Unknown backend \"{}\", using \"bytecode\"", config.backend);
+    }
+    for (auto [name, formula] : {
+             std::pair{"factor", &programs.factor},
+             std::pair{"jaggedness", &programs.jaggedness},
+             std::pair{"offset", &programs.offset},
+         }) {
+        formula->program.setBackend(backend);
+        if (backend == expr::Backend::Jit && !formula->program.isNative()) {
+            logger.info("The JIT can't compile the {} formula, interpreting it instead", name);
+        }
+    }
+    // Hashing the sources is cheaper than comparing them, and a collision is still caught by matches().
+    auto& generated = expr::codegen::generated;
+    auto  hash      = expr::codegen::hash(config.factor, config.jaggedness, config.offset, config.functions);
+    if (generated.hash != 0 && generated.hash == hash) {
+        std::array outputs{
+            std::pair{"factor", &programs.factor},
+            std::pair{"jaggedness", &programs.jaggedness},
+            std::pair{"offset", &programs.offset},
+        };
+        for (std::size_t i = 0; i < outputs.size(); i++) {
+            auto [name, formula] = outputs[i];
+            auto function        = generated.functions[i];
+            if (!function) continue;
+            if (expr::codegen::matches(formula->program, function)) {
+                formula->generated = function;
+                logger.info("Using the {} formula compiled into the plugin", name);
+            } else {
+                logger.warn("The {} formula compiled into the plugin doesn't match the interpreter, ignoring it", name);
+            }
+        }
+    }
+    if (config.fuse) {
+        std::array formulas{programs.factor.program, programs.jaggedness.program, programs.offset.program};
+        if (auto fused = expr::fuse(formulas)) {
+            programs.fused = std::move(*fused);
+            std::array outputs{&programs.factor, &programs.jaggedness, &programs.offset};
+            for (std::size_t i = 0; i < outputs.size(); i++) {
+                programs.fusedVanilla[i] = !outputs[i]->program.isIdentity() && outputs[i]->needsVanilla();
+            }
+        } else {
+            logger.info("Formulas use push, pop, user functions or the tree backend, evaluating them separately");
+        }
+    }
+    if (config.lookupTable.enabled) {
+        programs.factor.table     = std::make_shared<Approximation>("factor", config.lookupTable);
+        programs.jaggedness.table = std::make_shared<Approximation>("jaggedness", config.lookupTable);
+        programs.offset.table     = std::make_shared<Approximation>("offset", config.lookupTable);
+    }
+    return programs;
+}
+} // namespace
+
+bool Formula::needsVanilla() const {
+    auto& inputs = program.inputs();
+    return inputs.slots[static_cast<std::size_t>(expr::Slot::Ori)] || inputs.fallback;
+}
+
+Programs Programs::compile(const Config& config) {
+    // Formulas calling functions that failed to parse fail too and fall back to the vanilla value.
+    auto definitions = define_functions(config.functions).value_or(expr::Definitions{});
+    return configure(
+        {
+            {compile_or_identity("factor", config.factor, definitions)},
+            {compile_or_identity("jaggedness", config.jaggedness, definitions)},
+            {compile_or_identity("offset", config.offset, definitions)},
+        },
+        config
+    );
+}
+
+std::optional<Programs> Programs::tryCompile(const Config& config) {
+    auto definitions = define_functions(config.functions);
+    if (!definitions) return std::nullopt;
+    auto factor     = compile_formula("factor", config.factor, *definitions);
+    auto jaggedness = compile_formula("jaggedness", config.jaggedness, *definitions);
+    auto offset     = compile_formula("offset", config.offset, *definitions);
+    if (!factor || !jaggedness || !offset) return std::nullopt;
+    return configure({{std::move(*factor)}, {std::move(*jaggedness)}, {std::move(*offset)}}, config);
+}
+} // namespace climate_modify_config
@@ -1,9 +1,82 @@
 #pragma once
+#include "expr/Codegen.hpp"
+#include "expr/Expr.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
 #include <string>
 namespace climate_modify_config {
 struct Config {
     int           version = 1;
     std::string   factor = "ori;", jaggedness = "ori;", offset = "ori;";
-    static Config instance();
+    std::string   functions = ""; // definitions `name(params) = body;` the formulas can call, inlined into them
+    std::string   backend   = "bytecode"; // "bytecode", "jit" or "tree"
+    bool          fuse      = true; // evaluate the three formulas together and reuse the results per point
+    bool          hotReload = true; // recompile the formulas when config.json changes
+
+    struct Range {
+        float min;
+        float max;
+    };
+    /// Serve hook calls from a precomputed table instead of evaluating the formulas.
+    struct LookupTable {
+        bool  enabled         = false;
+        int   resolution      = 33;    // grid points per axis
+        float tolerance       = 0.01f; // largest accepted difference from exact evaluation
+        Range continentalness = {-1.2f, 1.2f};
+        Range erosion         = {-1.0f, 1.0f};
+        Range weirdness       = {-1.0f, 1.0f};
+    } lookupTable;
+    /// Count hook calls and time them, and record the distributions of their inputs and outputs.
+    struct Stats {
+        bool enabled     = false;
+        int  logInterval = 300; // seconds between logging the totals, 0 to log them only on disable
+    } stats;
+    /// Profile a sample of the formula evaluations and log the formulas annotated with where the time goes.
+    struct Profile {
+        bool enabled        = false;
+        int  sampleInterval = 64;      // hook calls on a thread per profiled one
+        int  reportAfter    = 1000000; // hook calls between reports, 0 to report only on /climateprofile and disable
+    } profile;
+
+    /// The configuration read when the plugin loaded; config.json is created with the defaults if missing.
+    static const Config& instance();
+    /// Reads config.json again. Returns nullopt and sets `error` if the file can't be read or isn't valid
+    /// JSON, leaving the file as it is.
+    static std::optional<Config> reload(std::string* error);
 };
-} // namespace climate_modify_config
\ No newline at end of file
+
+class Approximation;
+
+struct Formula {
+    expr::Program                  program;
+    std::shared_ptr<Approximation> table; // set when the lookup table mode is enabled
+    /// The formula compiled into the plugin by climate_codegen, set when config.json holds the formulas
+    /// it was generated from and it computes the same values as `program`.
+    expr::codegen::Function generated = nullptr;
+
+    /// Whether evaluating the program needs the vanilla value, which it reads as `ori` or falls back to.
+    [[nodiscard]] bool needsVanilla() const;
+};
+
+/// The configured formulas, compiled once when the plugin loads.
+struct Programs {
+    Formula factor, jaggedness, offset;
+    /// All three formulas in one pass, in that order; empty unless `fuse` is on and every formula can be fused.
+    expr::FusedProgram fused;
+    /// Which vanilla values `fused` reads, in the same order. Formulas that don't use `ori`, and identity
+    /// formulas, which the hooks answer with the vanilla value directly, are left out.
+    std::array<bool, 3> fusedVanilla{true, true, true};
+    /// Set by LivePrograms::publish() so per-thread caches can tell programs apart even if a new one is
+    /// allocated where an old one was.
+    std::uint64_t generation = 0;
+
+    /// Formulas that fail to compile are logged and fall back to the vanilla value.
+    static Programs compile(const Config& config);
+    /// Formulas that fail to compile are logged and nullopt is returned, so a reload keeps the running
+    /// programs.
+    static std::optional<Programs> tryCompile(const Config& config);
+};
+} // namespace climate_modify_config
@@ -0,0 +1,117 @@
+#include "FormulaProfiler.hpp"
+#include "OverworldClimateModify.h"
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace climate_modify_config {
+namespace {
+struct ThreadProfiles {
+    // Held by the owning thread while it records and by report() while it reads. Only sampled calls take
+    // it, so it is almost never contended.
+    std::mutex                   mutex;
+    std::uint64_t                generation = 0; // Programs::generation the profiles belong to
+    std::uint64_t                run        = 0; // enable() call they were recorded after
+    std::array<expr::Profile, 3> profiles;
+};
+
+// Profiles of threads that have exited stay registered so their samples keep counting; worldgen uses a
+// fixed pool of threads, so this doesn't grow.
+std::mutex                                   registry_mutex;
+std::vector<std::unique_ptr<ThreadProfiles>> registry;
+thread_local ThreadProfiles*                 local = nullptr;
+
+std::atomic<std::uint64_t> run{0};
+std::atomic<std::uint64_t> report_interval{0}; // hook calls
+std::atomic<std::uint64_t> samples{0};
+std::atomic<std::uint64_t> next_report{0};
+
+ThreadProfiles& thread_profiles() {
+    if (!local) {
+        auto profiles = std::make_unique<ThreadProfiles>();
+        local         = profiles.get();
+        std::lock_guard lock(registry_mutex);
+        registry.push_back(std::move(profiles));
+    }
+    return *local;
+}
+
+const Formula& formula(const Programs& programs, FormulaProfiler::Output output) {
+    return output == FormulaProfiler::Output::Factor     ? programs.factor
+         : output == FormulaProfiler::Output::Jaggedness ? programs.jaggedness
+                                                         : programs.offset;
+}
+} // namespace
+
+void FormulaProfiler::enable(int sampleInterval, std::uint64_t reportAfter) {
+    interval.store(std::max(sampleInterval, 1), std::memory_order_relaxed);
+    report_interval.store(reportAfter, std::memory_order_relaxed);
+    samples.store(0, std::memory_order_relaxed);
+    next_report.store(reportAfter, std::memory_order_relaxed);
+    run.fetch_add(1, std::memory_order_relaxed);
+    active.store(true, std::memory_order_relaxed);
+}
+
+void FormulaProfiler::disable() { active.store(false, std::memory_order_relaxed); }
+
+float FormulaProfiler::evaluate(const Programs& programs, Output output, const expr::Slots& slots, float fallback) {
+    auto& state = thread_profiles();
+    float res;
+    {
+        std::lock_guard lock(state.mutex);
+        auto            current = run.load(std::memory_order_relaxed);
+        if (state.generation != programs.generation || state.run != current) {
+            state.profiles   = {};
+            state.generation = programs.generation;
+            state.run        = current;
+        }
+        auto& profile = state.profiles[static_cast<std::size_t>(output)];
+        auto& program = formula(programs, output).program;
+        res           = program.evalFirst(slots, fallback, profile, expr::EvalContext::local());
+    }
+
+    auto every = report_interval.load(std::memory_order_relaxed);
+    if (every > 0) {
+        auto calls = (samples.fetch_add(1, std::memory_order_relaxed) + 1)
+                   * static_cast<std::uint64_t>(interval.load(std::memory_order_relaxed));
+        auto next  = next_report.load(std::memory_order_relaxed);
+        if (calls >= next && next_report.compare_exchange_strong(next, next + every)) report(programs);
+    }
+    return res;
+}
+
+void FormulaProfiler::report(const Programs& programs) {
+    std::array<expr::Profile, 3> totals;
+    {
+        std::lock_guard lock(registry_mutex);
+        auto            current = run.load(std::memory_order_relaxed);
+        for (auto& state : registry) {
+            std::lock_guard own(state->mutex);
+            if (state->generation != programs.generation || state->run != current) continue;
+            for (std::size_t i = 0; i < totals.size(); i++) totals[i].add(state->profiles[i]);
+        }
+    }
+
+    constexpr const char* names[] = {"factor", "jaggedness", "offset"};
+
+    auto& logger = overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger();
+    for (std::size_t i = 0; i < totals.size(); i++) {
+        auto& program = formula(programs, static_cast<Output>(i)).program;
+        // The hooks answer identity formulas with the vanilla value without evaluating them.
+        if (program.isIdentity()) continue;
+        logger.info("Profile of the {} formula, per profiled evaluation:", names[i]);
+        auto             text  = program.annotate(totals[i]);
+        std::string_view lines = text;
+        while (!lines.empty()) {
+            auto end = std::min(lines.find('\n'), lines.size());
+            logger.info("{}", lines.substr(0, end));
+            lines.remove_prefix(std::min(end + 1, lines.size()));
+        }
+    }
+}
+} // namespace climate_modify_config
@@ -0,0 +1,43 @@
+#pragma once
+#include "ClimateModifyConfig.hpp"
+#include "FusedMemo.hpp"
+#include "expr/Expr.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+namespace climate_modify_config {
+/// Profiles a sample of the hook calls, attributing the time of each formula to its operations. Every
+/// thread profiles one call in `sampleInterval` into profiles only it writes, and report() merges those
+/// of all threads. While disabled, a hook pays for one relaxed load; while enabled, the other calls also
+/// pay for a thread-local countdown.
+class FormulaProfiler {
+public:
+    using Output = FusedMemo::Output;
+
+    /// Starts over with empty profiles. The formulas are reported every `reportAfter` hook calls, counted
+    /// from the samples; zero only reports them on command and on disable.
+    static void enable(int sampleInterval, std::uint64_t reportAfter);
+    static void disable();
+    [[nodiscard]] static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    /// Whether the calling thread profiles this hook call.
+    [[nodiscard]] static bool sample() {
+        if (--countdown > 0) return false;
+        countdown = interval.load(std::memory_order_relaxed);
+        return true;
+    }
+
+    /// The formula's evalFirst(slots, fallback), profiled on the bytecode interpreter.
+    static float evaluate(const Programs& programs, Output output, const expr::Slots& slots, float fallback);
+
+    /// Logs every formula of `programs` with the costs profiled for it since enable() or since the
+    /// programs were loaded, whichever is later.
+    static void report(const Programs& programs);
+
+private:
+    static inline std::atomic<bool> active{false};
+    static inline std::atomic<int>  interval{64};
+    static inline thread_local int  countdown = 0;
+};
+} // namespace climate_modify_config
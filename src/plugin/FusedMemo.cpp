@@ -0,0 +1,33 @@
+#include "FusedMemo.hpp"
+#include "OverworldClimateModify.h"
+
+#include <atomic>
+
+namespace climate_modify_config {
+namespace {
+// The hit rate is logged each time this many more lookups have been flushed.
+constexpr std::uint64_t log_interval = 1 << 24;
+
+std::atomic<std::uint64_t> total_hits{0};
+std::atomic<std::uint64_t> total_misses{0};
+} // namespace
+
+void FusedMemo::flush() {
+    auto hits   = total_hits.fetch_add(entry.hits, std::memory_order_relaxed) + entry.hits;
+    auto misses = total_misses.fetch_add(entry.misses, std::memory_order_relaxed) + entry.misses;
+    entry.hits = entry.misses = 0;
+    if ((hits + misses) % log_interval < flush_interval) logStats();
+}
+
+void FusedMemo::logStats() {
+    auto hits   = total_hits.load(std::memory_order_relaxed);
+    auto misses = total_misses.load(std::memory_order_relaxed);
+    if (hits + misses == 0) return;
+    overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger().info(
+        "Fused formulas: {} of {} lookups served from the memo ({:.1f}%)",
+        hits,
+        hits + misses,
+        100.0 * static_cast<double>(hits) / static_cast<double>(hits + misses)
+    );
+}
+} // namespace climate_modify_config
@@ -0,0 +1,77 @@
+#pragma once
+#include "expr/Expr.hpp"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace climate_modify_config {
+/// Per-thread memo for the fused formulas. Worldgen asks for factor, jaggedness and offset of the same
+/// point one after another, so the first of the three calls evaluates them all and the other two are
+/// served from here.
+class FusedMemo {
+public:
+    /// Index of each formula in Programs::fused.
+    enum class Output : std::size_t { Factor, Jaggedness, Offset };
+
+    /// `vanilla()` returns the three vanilla values at the point; it only runs on a miss. The key is the
+    /// exact bits of the inputs, so a hit returns what evaluating again would. `generation` identifies the
+    /// programs `fused` belongs to (Programs::generation).
+    template <typename Vanilla>
+    static float get(
+        const expr::FusedProgram& fused,
+        std::uint64_t             generation,
+        const void*               shaper,
+        Output                    output,
+        float                     continentalness,
+        float                     erosion,
+        float                     weirdness,
+        const Vanilla&            vanilla
+    ) {
+        Key key{
+            generation,
+            shaper,
+            std::bit_cast<std::uint32_t>(continentalness),
+            std::bit_cast<std::uint32_t>(erosion),
+            std::bit_cast<std::uint32_t>(weirdness),
+        };
+        if (entry.key == key) {
+            entry.hits++;
+        } else {
+            std::array<float, 3> ori = vanilla();
+            fused.evalFirst(ori, continentalness, erosion, weirdness, entry.values);
+            entry.key = key;
+            entry.misses++;
+        }
+        if (entry.hits + entry.misses == flush_interval) flush();
+        return entry.values[static_cast<std::size_t>(output)];
+    }
+
+    /// Logs the hit rate summed over every thread's flushed counts.
+    static void logStats();
+
+private:
+    // Threads add their counts to the shared totals every this many lookups.
+    static constexpr std::uint32_t flush_interval = 1 << 16;
+
+    struct Key {
+        std::uint64_t generation = 0; // 0 is never published, so an empty entry never hits
+        const void*   shaper     = nullptr;
+        std::uint32_t continentalness = 0, erosion = 0, weirdness = 0;
+
+        bool operator==(const Key&) const = default;
+    };
+    struct Entry {
+        Key                  key;
+        std::array<float, 3> values{};
+        std::uint32_t        hits = 0, misses = 0;
+    };
+
+    static void flush();
+
+    static thread_local Entry entry;
+};
+
+inline thread_local FusedMemo::Entry FusedMemo::entry;
+} // namespace climate_modify_config
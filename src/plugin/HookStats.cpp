@@ -0,0 +1,245 @@
+#include "HookStats.hpp"
+#include "OverworldClimateModify.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace climate_modify_config {
+namespace {
+// Only the owning thread writes a counter, so a relaxed load and store is enough and avoids the locked
+// instructions a fetch_add would need.
+template <typename T>
+void add(std::atomic<T>& counter, T value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+struct RangeCounters {
+    std::atomic<float>  min{std::numeric_limits<float>::infinity()};
+    std::atomic<float>  max{-std::numeric_limits<float>::infinity()};
+    std::atomic<double> sum{0};
+
+    void record(float value) {
+        if (std::isnan(value)) return;
+        if (value < min.load(std::memory_order_relaxed)) min.store(value, std::memory_order_relaxed);
+        if (value > max.load(std::memory_order_relaxed)) max.store(value, std::memory_order_relaxed);
+        add(sum, static_cast<double>(value));
+    }
+    void reset() {
+        min.store(std::numeric_limits<float>::infinity(), std::memory_order_relaxed);
+        max.store(-std::numeric_limits<float>::infinity(), std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+    }
+    void addTo(HookStats::Range& range) const {
+        range.min  = std::min(range.min, min.load(std::memory_order_relaxed));
+        range.max  = std::max(range.max, max.load(std::memory_order_relaxed));
+        range.sum += sum.load(std::memory_order_relaxed);
+    }
+};
+
+using Counter = std::atomic<std::uint64_t>;
+
+struct HookCounters {
+    Counter                                                   calls{0}, vanillaCalls{0}, originNs{0}, evalNs{0};
+    std::array<Counter, HookStats::latency_buckets>           latency{};
+    std::array<RangeCounters, 3>                              inputs;
+    std::array<std::array<Counter, HookStats::value_bins>, 3> inputBins{};
+    RangeCounters                                             output;
+
+    void reset() {
+        for (auto counter : {&calls, &vanillaCalls, &originNs, &evalNs}) counter->store(0, std::memory_order_relaxed);
+        for (auto& counter : latency) counter.store(0, std::memory_order_relaxed);
+        for (auto& range : inputs) range.reset();
+        for (auto& bins : inputBins) {
+            for (auto& counter : bins) counter.store(0, std::memory_order_relaxed);
+        }
+        output.reset();
+    }
+};
+
+struct ThreadCounters {
+    std::atomic<std::uint64_t>  run{0}; // enable() call the counters were recorded after
+    std::array<HookCounters, 3> hooks;
+};
+
+// Counters of threads that have exited stay registered so their calls keep counting toward the totals;
+// worldgen uses a fixed pool of threads, so this doesn't grow.
+std::mutex                                   registry_mutex;
+std::vector<std::unique_ptr<ThreadCounters>> registry;
+thread_local ThreadCounters*                 local = nullptr;
+
+std::atomic<std::uint64_t> run{0};
+std::atomic<std::int64_t>  log_interval{0};
+std::atomic<std::int64_t>  next_log{0};
+
+// The calling thread's counters, cleared first if they were recorded before the last enable(). Only the
+// owning thread writes them, so enable() leaves the clearing to it rather than racing its updates.
+ThreadCounters& thread_counters() {
+    if (!local) {
+        auto counters = std::make_unique<ThreadCounters>();
+        local         = counters.get();
+        std::lock_guard lock(registry_mutex);
+        registry.push_back(std::move(counters));
+    }
+    auto current = run.load(std::memory_order_relaxed);
+    if (local->run.load(std::memory_order_relaxed) != current) {
+        for (auto& hook : local->hooks) hook.reset();
+        local->run.store(current, std::memory_order_release);
+    }
+    return *local;
+}
+
+std::size_t latency_bucket(std::int64_t ns) {
+    auto width = std::bit_width(static_cast<std::uint64_t>(std::max<std::int64_t>(ns, 0)));
+    return std::min<std::size_t>(width, HookStats::latency_buckets - 1);
+}
+
+std::size_t value_bin(float value) {
+    auto bin = std::floor((value - HookStats::value_bins_from) / HookStats::value_bin_width);
+    return static_cast<std::size_t>(std::clamp(bin, 0.0f, static_cast<float>(HookStats::value_bins - 1)));
+}
+
+// Upper bound in ns of the latency bucket holding the given fraction of calls.
+std::uint64_t percentile(const HookStats::Hook& hook, double fraction) {
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < hook.latency.size(); i++) {
+        seen += hook.latency[i];
+        if (static_cast<double>(seen) >= fraction * static_cast<double>(hook.calls)) return std::uint64_t{1} << i;
+    }
+    return std::uint64_t{1} << (hook.latency.size() - 1);
+}
+
+double mean(const HookStats::Range& range, std::uint64_t count) {
+    return count ? range.sum / static_cast<double>(count) : 0.0;
+}
+
+// Percentage of values in each bin, separated by spaces.
+std::string format_bins(const HookStats::Bins& bins) {
+    std::uint64_t total = 0;
+    for (auto count : bins) total += count;
+    std::string res;
+    for (auto count : bins) {
+        char buffer[16];
+        auto percent = total ? 100.0 * static_cast<double>(count) / static_cast<double>(total) : 0.0;
+        auto end     = std::to_chars(buffer, buffer + sizeof(buffer), percent, std::chars_format::fixed, 1).ptr;
+        if (!res.empty()) res += ' ';
+        res.append(buffer, end);
+    }
+    return res;
+}
+} // namespace
+
+void HookStats::enable(std::chrono::seconds interval) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+    log_interval.store(ns, std::memory_order_relaxed);
+    next_log.store(now() + ns, std::memory_order_relaxed);
+    run.fetch_add(1, std::memory_order_relaxed);
+    active.store(true, std::memory_order_relaxed);
+}
+
+void HookStats::disable() { active.store(false, std::memory_order_relaxed); }
+
+float HookStats::Call::finish(float result) {
+    auto  end   = now();
+    auto  total = end - mStart;
+    auto& hook  = thread_counters().hooks[static_cast<std::size_t>(mOutput)];
+    add<std::uint64_t>(hook.calls, 1);
+    if (mVanilla) add<std::uint64_t>(hook.vanillaCalls, 1);
+    add(hook.originNs, static_cast<std::uint64_t>(mOriginNs));
+    add(hook.evalNs, static_cast<std::uint64_t>(std::max<std::int64_t>(total - mOriginNs, 0)));
+    add<std::uint64_t>(hook.latency[latency_bucket(total)], 1);
+    for (std::size_t i = 0; i < 3; i++) {
+        hook.inputs[i].record(mInputs[i]);
+        if (!std::isnan(mInputs[i])) add<std::uint64_t>(hook.inputBins[i][value_bin(mInputs[i])], 1);
+    }
+    hook.output.record(result);
+
+    auto interval = log_interval.load(std::memory_order_relaxed);
+    auto next     = next_log.load(std::memory_order_relaxed);
+    if (interval > 0 && end >= next && next_log.compare_exchange_strong(next, end + interval)) log();
+    return result;
+}
+
+HookStats::Summary HookStats::collect() {
+    Summary         summary;
+    std::lock_guard lock(registry_mutex);
+    auto            current = run.load(std::memory_order_relaxed);
+    for (auto& counters : registry) {
+        // Threads that haven't recorded since enable() hold counts from before it.
+        if (counters->run.load(std::memory_order_acquire) != current) continue;
+        for (std::size_t h = 0; h < 3; h++) {
+            auto& from         = counters->hooks[h];
+            auto& to           = summary[h];
+            to.calls          += from.calls.load(std::memory_order_relaxed);
+            to.vanillaCalls   += from.vanillaCalls.load(std::memory_order_relaxed);
+            to.originNs       += from.originNs.load(std::memory_order_relaxed);
+            to.evalNs         += from.evalNs.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < latency_buckets; i++) {
+                to.latency[i] += from.latency[i].load(std::memory_order_relaxed);
+            }
+            for (std::size_t i = 0; i < 3; i++) {
+                from.inputs[i].addTo(to.inputs[i]);
+                for (std::size_t b = 0; b < value_bins; b++) {
+                    to.inputBins[i][b] += from.inputBins[i][b].load(std::memory_order_relaxed);
+                }
+            }
+            from.output.addTo(to.output);
+        }
+    }
+    return summary;
+}
+
+void HookStats::log() {
+    auto& logger  = overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger();
+    auto  summary = collect();
+
+    constexpr const char* hooks[]  = {"factor", "jaggedness", "offset"};
+    constexpr const char* inputs[] = {"continentalness", "erosion", "weirdness"};
+    Hook                  all;
+    for (std::size_t h = 0; h < 3; h++) {
+        auto& hook = summary[h];
+        if (hook.calls == 0) continue;
+        auto calls = static_cast<double>(hook.calls);
+        logger.info(
+            "Hook {}: {} calls, {:.1f}% ran vanilla; per call {:.1f} ns in vanilla, {:.1f} ns in the formula; "
+            "latency p50 < {} ns, p99 < {} ns; output min {}, mean {:.4f}, max {}",
+            hooks[h],
+            hook.calls,
+            100.0 * static_cast<double>(hook.vanillaCalls) / calls,
+            static_cast<double>(hook.originNs) / calls,
+            static_cast<double>(hook.evalNs) / calls,
+            percentile(hook, 0.5),
+            percentile(hook, 0.99),
+            hook.output.min,
+            mean(hook.output, hook.calls),
+            hook.output.max
+        );
+        all.calls += hook.calls;
+        for (std::size_t i = 0; i < 3; i++) {
+            all.inputs[i].min  = std::min(all.inputs[i].min, hook.inputs[i].min);
+            all.inputs[i].max  = std::max(all.inputs[i].max, hook.inputs[i].max);
+            all.inputs[i].sum += hook.inputs[i].sum;
+            for (std::size_t b = 0; b < value_bins; b++) all.inputBins[i][b] += hook.inputBins[i][b];
+        }
+    }
+    if (all.calls == 0) return;
+    // The three hooks see the same points, so their inputs are reported together.
+    for (std::size_t i = 0; i < 3; i++) {
+        logger.info(
+            "Hook input {}: min {}, mean {:.4f}, max {}; % per {}-wide bin from {}: {}",
+            inputs[i],
+            all.inputs[i].min,
+            mean(all.inputs[i], all.calls),
+            all.inputs[i].max,
+            value_bin_width,
+            value_bins_from,
+            format_bins(all.inputBins[i])
+        );
+    }
+}
+} // namespace climate_modify_config
@@ -0,0 +1,94 @@
+#pragma once
+#include "FusedMemo.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace climate_modify_config {
+/// Call counts, timings and value distributions of the TerrainShaper hooks. Every thread records into
+/// counters only it writes, so recording takes no locks; collect() sums the counters of all threads.
+/// While disabled, a hook pays for one relaxed load.
+class HookStats {
+public:
+    using Output = FusedMemo::Output;
+
+    /// Bucket i counts calls that took less than 2^i ns (and at least 2^(i-1) ns); the last bucket also
+    /// counts everything slower.
+    static constexpr std::size_t latency_buckets = 24;
+    /// Inputs are binned into bins of value_bin_width starting at value_bins_from; values outside fall
+    /// into the first or last bin.
+    static constexpr std::size_t value_bins      = 16;
+    static constexpr float       value_bins_from = -2.0f;
+    static constexpr float       value_bin_width = 0.25f;
+
+    struct Range {
+        float  min = std::numeric_limits<float>::infinity();
+        float  max = -std::numeric_limits<float>::infinity();
+        double sum = 0;
+    };
+    using Bins = std::array<std::uint64_t, value_bins>;
+    struct Hook {
+        std::uint64_t                              calls        = 0;
+        std::uint64_t                              vanillaCalls = 0; // calls that ran `origin`
+        std::uint64_t                              originNs     = 0;
+        std::uint64_t                              evalNs       = 0;
+        std::array<std::uint64_t, latency_buckets> latency{};
+        std::array<Range, 3>                       inputs; // continentalness, erosion, weirdness
+        std::array<Bins, 3>                        inputBins{};
+        Range                                      output;
+    };
+    /// Totals since enable(), indexed by Output.
+    using Summary = std::array<Hook, 3>;
+
+    /// Starts recording from zero, dropping the counts of earlier enable() calls. Every `interval` the totals
+    /// are logged by whichever hook call notices first; zero only logs them on disable.
+    static void enable(std::chrono::seconds interval);
+    static void disable();
+    [[nodiscard]] static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] static Summary collect();
+    static void                  log();
+
+    /// Times one hook call. Route every call of the vanilla function through origin() and the hook's
+    /// result through finish(); whatever is not spent in origin() counts as evaluation.
+    class Call {
+    public:
+        Call(Output output, float continentalness, float erosion, float weirdness)
+        : mOutput(output),
+          mInputs{continentalness, erosion, weirdness},
+          mStart(now()) {}
+
+        template <typename Vanilla>
+        auto origin(const Vanilla& vanilla) {
+            auto begin   = now();
+            auto result  = vanilla();
+            mOriginNs   += now() - begin;
+            mVanilla     = true;
+            return result;
+        }
+
+        float finish(float result);
+
+    private:
+        Output               mOutput;
+        std::array<float, 3> mInputs;
+        std::int64_t         mStart;
+        std::int64_t         mOriginNs = 0;
+        bool                 mVanilla  = false;
+    };
+
+private:
+    static std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()
+        )
+            .count();
+    }
+
+    static inline std::atomic<bool> active{false};
+};
+} // namespace climate_modify_config
@@ -1,12 +1,108 @@
+#include "Approximation.hpp"
 #include "ClimateModifyConfig.hpp"
-#include "Expr.hpp"
+#include "FormulaProfiler.hpp"
+#include "FusedMemo.hpp"
+#include "HookStats.hpp"
 #include "OverworldClimateModify.h"
+#include "expr/Expr.hpp"
 
+#include <array>
 
 #include "ll/api/memory/Hook.h"
 #include "mc/world/level/biome/TerrainShaper.h"
 
 
+namespace {
+using Output = climate_modify_config::FusedMemo::Output;
+
+// Runs the original factor, jaggedness and offset where `needed`, giving 0 for the others; defined after
+// the hooks whose `origin` it calls.
+std::array<float, 3> vanilla_all(
+    TerrainShaper*             self,
+    const std::array<bool, 3>& needed,
+    float                      continentalness,
+    float                      erosion,
+    float                      weirdness
+);
+
+// `vanilla(c, e, w)` runs the original function and `vanilla_all()` the ones the fused formulas read; both
+// are skipped when the formula doesn't need them, the lookup table covers the input or the memo has the
+// point. An identity formula returns the vanilla value without evaluating anything, and a formula compiled
+// into the plugin runs that code instead of the engine. Calls the profiler samples evaluate the formula
+// alone on the bytecode interpreter.
+template <typename Vanilla, typename VanillaAll>
+float evaluate(
+    const climate_modify_config::Programs& programs,
+    Output                                 output,
+    TerrainShaper*                         self,
+    const Vanilla&                         vanilla,
+    const VanillaAll&                      vanilla_all,
+    float                                  continentalness,
+    float                                  erosion,
+    float                                  weirdness
+) {
+    auto& formula = output == Output::Factor     ? programs.factor
+                  : output == Output::Jaggedness ? programs.jaggedness
+                                                 : programs.offset;
+    if (formula.program.isIdentity()) return vanilla(continentalness, erosion, weirdness);
+    if (climate_modify_config::FormulaProfiler::enabled() && climate_modify_config::FormulaProfiler::sample())
+        [[unlikely]] {
+        auto ori = formula.needsVanilla() ? vanilla(continentalness, erosion, weirdness) : 0.0f;
+        return climate_modify_config::FormulaProfiler::evaluate(
+            programs,
+            output,
+            {ori, continentalness, erosion, weirdness},
+            ori
+        );
+    }
+    if (formula.table) {
+        auto table = formula.table->get(formula.program, self, vanilla);
+        if (table && table->contains(continentalness, erosion, weirdness)) {
+            return table->sample(continentalness, erosion, weirdness);
+        }
+    }
+    if (formula.generated) {
+        auto ori = formula.needsVanilla() ? vanilla(continentalness, erosion, weirdness) : 0.0f;
+        return formula.generated(ori, continentalness, erosion, weirdness);
+    }
+    if (programs.fused) {
+        return climate_modify_config::FusedMemo::get(
+            programs.fused,
+            programs.generation,
+            self,
+            output,
+            continentalness,
+            erosion,
+            weirdness,
+            vanilla_all
+        );
+    }
+    auto ori = formula.needsVanilla() ? vanilla(continentalness, erosion, weirdness) : 0.0f;
+    return formula.program.evalFirst({ori, continentalness, erosion, weirdness}, ori);
+}
+
+template <typename Vanilla>
+float apply(
+    Output         output,
+    TerrainShaper* self,
+    const Vanilla& vanilla,
+    float          continentalness,
+    float          erosion,
+    float          weirdness
+) {
+    // Pinned for the whole call so a reload can't free the programs under us.
+    auto programs = overworld_climate_modify::OverworldClimateModify::getInstance().getPrograms().read();
+    auto all      = [&] { return vanilla_all(self, programs->fusedVanilla, continentalness, erosion, weirdness); };
+    if (!climate_modify_config::HookStats::enabled()) [[likely]] {
+        return evaluate(*programs, output, self, vanilla, all, continentalness, erosion, weirdness);
+    }
+    climate_modify_config::HookStats::Call call(output, continentalness, erosion, weirdness);
+    auto timed     = [&](float c, float e, float w) { return call.origin([&] { return vanilla(c, e, w); }); };
+    auto timed_all = [&] { return call.origin(all); };
+    return call.finish(evaluate(*programs, output, self, timed, timed_all, continentalness, erosion, weirdness));
+}
+} // namespace
+
 LL_AUTO_STATIC_HOOK(
     TerrainShaper_factor,
     HookPriority::Normal,
@@ -17,28 +113,8 @@ LL_AUTO_STATIC_HOOK(
     float          erosion,
     float          weirdness
 ) {
-    auto                                                ori = origin(self, continentalness, erosion, weirdness);
-    std::unordered_map<std::string, std::vector<float>> params{
-        {"ori",             {ori}            },
-        {"continentalness", {continentalness}},
-        {"erosion",         {erosion}        },
-        {"weirdness",       {weirdness}      },
-    };
-    std::unordered_map<std::string, std::function<std::vector<float>(const std::vector<std::vector<float>>&)>>
-        functions{
-            {"info", [](const std::vector<std::vector<float>>& args) {
-                 for (auto i : args[0]) {
-                     overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger().info(
-                         "{}:{}",
-                         __FUNCSIG__,
-                         i
-                     );
-                 }
-                 return args[0];
-             }}
-    };
-    auto res = expr::eval(climate_modify_config::Config::instance().factor, params, functions);
-    return res[0];
+    auto vanilla = [self](float c, float e, float w) { return origin(self, c, e, w); };
+    return apply(Output::Factor, self, vanilla, continentalness, erosion, weirdness);
 }
 LL_AUTO_STATIC_HOOK(
     TerrainShaper_jaggedness,
@@ -50,28 +126,8 @@ LL_AUTO_STATIC_HOOK(
     float          erosion,
     float          weirdness
 ) {
-    auto                                                ori = origin(self, continentalness, erosion, weirdness);
-    std::unordered_map<std::string, std::vector<float>> params{
-        {"ori",             {ori}            },
-        {"continentalness", {continentalness}},
-        {"erosion",         {erosion}        },
-        {"weirdness",       {weirdness}      },
-    };
-    std::unordered_map<std::string, std::function<std::vector<float>(const std::vector<std::vector<float>>&)>>
-        functions{
-            {"info", [](const std::vector<std::vector<float>>& args) {
-                 for (auto i : args[0]) {
-                     overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger().info(
-                         "{}:{}",
-                         __FUNCSIG__,
-                         i
-                     );
-                 }
-                 return args[0];
-             }}
-    };
-    auto res = expr::eval(climate_modify_config::Config::instance().jaggedness, params, functions);
-    return res[0];
+    auto vanilla = [self](float c, float e, float w) { return origin(self, c, e, w); };
+    return apply(Output::Jaggedness, self, vanilla, continentalness, erosion, weirdness);
 }
 
 LL_AUTO_STATIC_HOOK(
@@ -84,26 +140,22 @@ LL_AUTO_STATIC_HOOK(
     float          erosion,
     float          weirdness
 ) {
-    auto                                                ori = origin(self, continentalness, erosion, weirdness);
-    std::unordered_map<std::string, std::vector<float>> params{
-        {"ori",             {ori}            },
-        {"continentalness", {continentalness}},
-        {"erosion",         {erosion}        },
-        {"weirdness",       {weirdness}      },
-    };
-    std::unordered_map<std::string, std::function<std::vector<float>(const std::vector<std::vector<float>>&)>>
-        functions{
-            {"info", [](const std::vector<std::vector<float>>& args) {
-                 for (auto i : args[0]) {
-                     overworld_climate_modify::OverworldClimateModify::getInstance().getSelf().getLogger().info(
-                         "{}:{}",
-                         __FUNCSIG__,
-                         i
-                     );
-                 }
-                 return args[0];
-             }}
+    auto vanilla = [self](float c, float e, float w) { return origin(self, c, e, w); };
+    return apply(Output::Offset, self, vanilla, continentalness, erosion, weirdness);
+}
+
+namespace {
+std::array<float, 3> vanilla_all(
+    TerrainShaper*             self,
+    const std::array<bool, 3>& needed,
+    float                      continentalness,
+    float                      erosion,
+    float                      weirdness
+) {
+    return {
+        needed[0] ? TerrainShaper_factor::origin(self, continentalness, erosion, weirdness) : 0.0f,
+        needed[1] ? TerrainShaper_jaggedness::origin(self, continentalness, erosion, weirdness) : 0.0f,
+        needed[2] ? TerrainShaper_offset::origin(self, continentalness, erosion, weirdness) : 0.0f,
     };
-    auto res = expr::eval(climate_modify_config::Config::instance().offset, params, functions);
-    return res[0];
-}
\ No newline at end of file
+}
+} // namespace
@@ -0,0 +1,80 @@
+#include "LivePrograms.hpp"
+
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace climate_modify_config {
+/// The epoch a thread started reading in, or 0 while it isn't reading.
+struct LivePrograms::Reader::Slot {
+    std::atomic<std::uint64_t> epoch{0};
+    std::uint32_t              depth = 0; // nested reads, only touched by the owning thread
+    Slot*                      next  = nullptr;
+};
+
+namespace {
+using Slot = LivePrograms::Reader::Slot;
+
+// Slots are pushed once per thread and never removed, so publish() can walk the list without a lock. A
+// thread that exits leaves its slot at 0, which never holds programs back.
+std::atomic<Slot*> slots{nullptr};
+thread_local Slot* local = nullptr;
+
+// A reader's slot store must be visible before it loads the pointer, and publish()'s swap before it
+// checks the slots. Rather than a full fence on every read, readers only stop the compiler from
+// reordering and publish() forces the store buffers of every core to drain.
+#ifdef _WIN32
+void reader_fence() { std::atomic_signal_fence(std::memory_order_seq_cst); }
+void publisher_fence() { FlushProcessWriteBuffers(); }
+#else
+void reader_fence() { std::atomic_thread_fence(std::memory_order_seq_cst); }
+void publisher_fence() { std::atomic_thread_fence(std::memory_order_seq_cst); }
+#endif
+
+Slot& thread_slot() {
+    if (!local) {
+        local       = new Slot;
+        local->next = slots.load(std::memory_order_relaxed);
+        while (!slots.compare_exchange_weak(local->next, local, std::memory_order_release)) {}
+    }
+    return *local;
+}
+} // namespace
+
+LivePrograms::Reader::~Reader() {
+    if (--mSlot.depth == 0) mSlot.epoch.store(0, std::memory_order_release);
+}
+
+LivePrograms::~LivePrograms() { delete mCurrent.load(); }
+
+// If publish() sees a reader's slot as 0, the fences order the reader's pointer load after the swap. If it
+// sees the new epoch, the reader acquired it from the fetch_add that follows the swap. Either way the
+// reader has the new programs.
+LivePrograms::Reader LivePrograms::read() const {
+    auto& slot = thread_slot();
+    if (slot.depth++ == 0) {
+        slot.epoch.store(mEpoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+        reader_fence();
+    }
+    return Reader(slot, mCurrent.load(std::memory_order_acquire));
+}
+
+void LivePrograms::publish(std::unique_ptr<Programs> programs) {
+    programs->generation = ++mGeneration;
+    auto old             = mCurrent.exchange(programs.release());
+    auto epoch           = mEpoch.fetch_add(1) + 1;
+    if (!old) return;
+    publisher_fence();
+    for (auto slot = slots.load(std::memory_order_acquire); slot; slot = slot->next) {
+        for (;;) {
+            auto seen = slot->epoch.load(std::memory_order_acquire);
+            if (seen == 0 || seen >= epoch) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    delete old;
+}
+} // namespace climate_modify_config
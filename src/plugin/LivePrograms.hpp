@@ -0,0 +1,55 @@
+#pragma once
+#include "ClimateModifyConfig.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace climate_modify_config {
+/// The programs the hooks run, replaceable while the hooks are running. Readers never block: read()
+/// records the current epoch in a slot owned by the calling thread and loads a pointer. publish() swaps
+/// the pointer, advances the epoch and frees the old programs once no thread is still reading in an
+/// earlier epoch.
+class LivePrograms {
+public:
+    /// Keeps the programs it points to alive until destroyed. Reads may nest on one thread.
+    class Reader {
+    public:
+        /// A thread's reader state, defined in LivePrograms.cpp.
+        struct Slot;
+
+        Reader(const Reader&)            = delete;
+        Reader& operator=(const Reader&) = delete;
+        ~Reader();
+
+        [[nodiscard]] const Programs& operator*() const { return *mPrograms; }
+        [[nodiscard]] const Programs* operator->() const { return mPrograms; }
+
+    private:
+        friend class LivePrograms;
+
+        Reader(Slot& slot, const Programs* programs) : mSlot(slot), mPrograms(programs) {}
+
+        Slot&           mSlot;
+        const Programs* mPrograms;
+    };
+
+    LivePrograms() = default;
+    /// No thread may be reading any more.
+    ~LivePrograms();
+    LivePrograms(const LivePrograms&)            = delete;
+    LivePrograms& operator=(const LivePrograms&) = delete;
+
+    /// Must not be called before the first publish().
+    [[nodiscard]] Reader read() const;
+
+    /// Makes `programs` current and assigns its generation. Returns once the previous programs are freed,
+    /// which waits for the hook calls still using them to return. Publishers must not run concurrently.
+    void publish(std::unique_ptr<Programs> programs);
+
+private:
+    std::atomic<const Programs*> mCurrent{nullptr};
+    std::atomic<std::uint64_t>   mEpoch{1};
+    std::uint64_t                mGeneration = 0;
+};
+} // namespace climate_modify_config
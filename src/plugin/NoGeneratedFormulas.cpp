@@ -0,0 +1,5 @@
+#include "expr/Codegen.hpp"
+
+// Built instead of the output of climate_codegen when the `formulas` option is not set, so no config
+// matches and every formula runs on the runtime engine.
+const expr::codegen::Formulas expr::codegen::generated{};
@@ -1,34 +1,150 @@
 #include "plugin/OverworldClimateModify.h"
+#include "plugin/FormulaProfiler.hpp"
+#include "plugin/FusedMemo.hpp"
+#include "plugin/HookStats.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <system_error>
+#include <utility>
 
+#include "ll/api/command/CommandHandle.h"
+#include "ll/api/command/CommandRegistrar.h"
 #include "ll/api/plugin/NativePlugin.h"
 #include "ll/api/plugin/RegisterHelper.h"
+#include "mc/server/commands/CommandOrigin.h"
+#include "mc/server/commands/CommandOutput.h"
+#include "mc/server/commands/CommandPermissionLevel.h"
 
 namespace overworld_climate_modify {
 
 static std::unique_ptr<OverworldClimateModify> instance;
 
+namespace {
+// A reload that leaves the statistics on with the same interval keeps counting. Enabling them again would drop
+// the counts so far, so they are logged first when the interval changes.
+void configure_stats(const climate_modify_config::Config::Stats& stats) {
+    static std::chrono::seconds interval{}; // of the running statistics
+    if (!stats.enabled) {
+        climate_modify_config::HookStats::disable();
+        return;
+    }
+    auto requested = std::chrono::seconds(std::max(stats.logInterval, 0));
+    if (climate_modify_config::HookStats::enabled()) {
+        if (requested == interval) return;
+        climate_modify_config::HookStats::log();
+    }
+    interval = requested;
+    climate_modify_config::HookStats::enable(interval);
+}
+
+void configure_profiler(const climate_modify_config::Config::Profile& profile) {
+    if (profile.enabled) {
+        climate_modify_config::FormulaProfiler::enable(
+            profile.sampleInterval,
+            static_cast<std::uint64_t>(std::max(profile.reportAfter, 0))
+        );
+    } else {
+        climate_modify_config::FormulaProfiler::disable();
+    }
+}
+
+// /climateprofile logs the formulas with the costs profiled so far.
+void register_commands() {
+    static bool registered = false;
+    if (std::exchange(registered, true)) return;
+    auto& command = ll::command::CommandRegistrar::getInstance().getOrCreateCommand(
+        "climateprofile",
+        "Logs the climate formulas annotated with where their evaluation time goes.",
+        CommandPermissionLevel::GameDirectors
+    );
+    command.overload().execute([](CommandOrigin const&, CommandOutput& output) {
+        if (!climate_modify_config::FormulaProfiler::enabled()) {
+            output.error("Profiling is off; set profile.enabled in config.json");
+            return;
+        }
+        auto programs = OverworldClimateModify::getInstance().getPrograms().read();
+        climate_modify_config::FormulaProfiler::report(*programs);
+        output.success("Logged the formula profile to the console");
+    });
+}
+} // namespace
+
 OverworldClimateModify& OverworldClimateModify::getInstance() { return *instance; }
 
 bool OverworldClimateModify::load() {
     getSelf().getLogger().info("Loading...");
-    // Code for loading the plugin goes here.
+    auto& config = climate_modify_config::Config::instance();
+    mPrograms.publish(
+        std::make_unique<climate_modify_config::Programs>(climate_modify_config::Programs::compile(config))
+    );
+    configure_stats(config.stats);
+    configure_profiler(config.profile);
     return true;
 }
 
 bool OverworldClimateModify::enable() {
     getSelf().getLogger().info("Enabling...");
-    // Code for enabling the plugin goes here.
+    register_commands();
+    if (climate_modify_config::Config::instance().hotReload) {
+        mWatcher = std::jthread([this](std::stop_token stop) { watch(stop); });
+    }
     return true;
 }
 
 bool OverworldClimateModify::disable() {
     getSelf().getLogger().info("Disabling...");
-    // Code for disabling the plugin goes here.
+    mWatcher = {};
+    climate_modify_config::FusedMemo::logStats();
+    if (climate_modify_config::HookStats::enabled()) {
+        climate_modify_config::HookStats::disable();
+        climate_modify_config::HookStats::log();
+    }
+    if (climate_modify_config::FormulaProfiler::enabled()) {
+        climate_modify_config::FormulaProfiler::disable();
+        climate_modify_config::FormulaProfiler::report(*mPrograms.read());
+    }
     return true;
 }
 
+bool OverworldClimateModify::reload() {
+    auto&       logger = getSelf().getLogger();
+    std::string error;
+    auto        config = climate_modify_config::Config::reload(&error);
+    if (!config) {
+        logger.error("Failed to reload the config: {}", error);
+        return false;
+    }
+    auto programs = climate_modify_config::Programs::tryCompile(*config);
+    if (!programs) {
+        logger.error("Keeping the previous formulas");
+        return false;
+    }
+    mPrograms.publish(std::make_unique<climate_modify_config::Programs>(std::move(*programs)));
+    configure_stats(config->stats);
+    configure_profiler(config->profile);
+    logger.info("Reloaded the formulas");
+    return true;
+}
+
+void OverworldClimateModify::watch(std::stop_token stop) {
+    std::mutex                  mutex;
+    std::condition_variable_any wake;
+    std::unique_lock            lock(mutex);
+    std::error_code             error;
+    auto                        last = std::filesystem::last_write_time(getConfigFilePath(), error);
+    while (!wake.wait_for(lock, stop, std::chrono::seconds(1), [] { return false; }) && !stop.stop_requested()) {
+        auto time = std::filesystem::last_write_time(getConfigFilePath(), error);
+        if (error || time == last) continue;
+        reload();
+        // Loading may have rewritten the file, which isn't another edit.
+        last = std::filesystem::last_write_time(getConfigFilePath(), error);
+    }
+}
+
 std::filesystem::path OverworldClimateModify::getConfigDirPath() { return getSelf().getConfigDir(); }
 
 std::filesystem::path OverworldClimateModify::getConfigFilePath() { return getConfigDirPath() / "config.json"; }
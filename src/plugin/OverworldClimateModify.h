@@ -1,5 +1,11 @@
 #pragma once
 
+#include "ClimateModifyConfig.hpp"
+#include "LivePrograms.hpp"
+
+#include <stop_token>
+#include <thread>
+
 #include "ll/api/plugin/NativePlugin.h"
 
 namespace overworld_climate_modify {
@@ -26,11 +32,23 @@ class OverworldClimateModify {
     // /// @return True if the plugin is unloaded successfully.
     // bool unload();
 
+    /// Reads config.json again and swaps in the new formulas while the hooks keep running. If the file
+    /// can't be read or a formula doesn't compile, the error is logged and the running formulas stay.
+    /// @return True if the new formulas are in use.
+    bool reload();
+
     std::filesystem::path getConfigDirPath();
     std::filesystem::path getConfigFilePath();
 
+    [[nodiscard]] const climate_modify_config::LivePrograms& getPrograms() const { return mPrograms; }
+
 private:
-    ll::plugin::NativePlugin& mSelf;
+    // Reloads whenever config.json's modification time changes, checking once a second.
+    void watch(std::stop_token stop);
+
+    ll::plugin::NativePlugin&           mSelf;
+    climate_modify_config::LivePrograms mPrograms;
+    std::jthread                        mWatcher; // runs watch() while enabled and `hotReload` is on
 };
 
 } // namespace overworld_climate_modify
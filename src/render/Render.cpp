@@ -0,0 +1,609 @@
+// Renders the formulas of a config.json offline for tuning them without a server. factor, jaggedness and
+// offset are evaluated over a dense continentalness x erosion x weirdness grid on every core. For each
+// output, one weirdness slice is written as a PPM heatmap, as a heatmap of the difference from vanilla and
+// as CSV. Statistics over the whole grid go to stdout as JSON.
+//
+// Vanilla values come from a sample file dumped from the game. It is CSV with the columns continentalness,
+// erosion, weirdness, factor, jaggedness and offset, and its rows form a regular grid in any order. The
+// values are interpolated trilinearly onto the render grid and clamped at its edges. Without the file,
+// `ori` is 0.
+//
+// With --profile, one row of samples in every ROWS is evaluated again with the profiler, and the formulas
+// are written to PREFIX-profile.txt annotated with the time each of their operations takes.
+//
+// Usage: climate_render --config FILE [--vanilla FILE] [--out PREFIX] [--grid C,E,W] [--slice K]
+//            [--continentalness MIN:MAX] [--erosion MIN:MAX] [--weirdness MIN:MAX]
+//            [--backend tree|bytecode|jit] [--threads N] [--profile ROWS]
+
+#include "expr/Expr.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr const char* output_names[] = {"factor", "jaggedness", "offset"};
+
+struct Axis {
+    float       min   = 0;
+    float       max   = 0;
+    std::size_t count = 1;
+
+    [[nodiscard]] float at(std::size_t i) const {
+        if (count == 1) return min;
+        return min + (max - min) * static_cast<float>(i) / static_cast<float>(count - 1);
+    }
+};
+
+struct Options {
+    std::string config;
+    std::string vanilla;
+    std::string out = "climate";
+    Axis        continentalness{-1.2f, 1.2f, 512};
+    Axis        erosion{-1.0f, 1.0f, 512};
+    Axis        weirdness{-1.0f, 1.0f, 64};
+    std::size_t slice   = std::numeric_limits<std::size_t>::max(); // defaults to the middle one
+    std::string backend = "bytecode";
+    unsigned    threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t profile = 0; // rows per profiled one, 0 for none
+};
+
+// Where x falls between the nodes of a sorted axis: node i, and how far towards node i + 1. Outside the
+// axis the nearest end is used.
+struct Bracket {
+    std::size_t i = 0;
+    float       t = 0;
+};
+Bracket bracket(const std::vector<float>& nodes, float x) {
+    if (nodes.size() < 2 || !(x > nodes.front())) return {0, 0.0f};
+    if (!(x < nodes.back())) return {nodes.size() - 2, 1.0f};
+    auto i = static_cast<std::size_t>(std::upper_bound(nodes.begin(), nodes.end(), x) - nodes.begin()) - 1;
+    return {i, (x - nodes[i]) / (nodes[i + 1] - nodes[i])};
+}
+
+/// Vanilla values on the grid of a sample file.
+class VanillaGrid {
+public:
+    /// An empty grid gives 0 everywhere.
+    VanillaGrid() = default;
+
+    static std::optional<VanillaGrid> load(const std::string& path, std::string* error);
+
+    [[nodiscard]] bool empty() const { return mValues[0].empty(); }
+
+    /// Fills `line` with the vanilla `output` at every continentalness node for fixed erosion and
+    /// weirdness, so a row of samples only interpolates along one axis. An empty grid has no nodes.
+    void line(std::size_t output, float erosion, float weirdness, std::vector<float>& line) const {
+        auto& c = mAxes[0];
+        line.resize(c.size());
+        auto e = bracket(mAxes[1], erosion), w = bracket(mAxes[2], weirdness);
+        auto e1 = std::min(e.i + 1, mAxes[1].size() - 1), w1 = std::min(w.i + 1, mAxes[2].size() - 1);
+        for (std::size_t k = 0; k < c.size(); k++) {
+            auto v00 = value(output, k, e.i, w.i), v01 = value(output, k, e.i, w1);
+            auto v10 = value(output, k, e1, w.i), v11 = value(output, k, e1, w1);
+            auto v0  = v00 + w.t * (v01 - v00);
+            auto v1  = v10 + w.t * (v11 - v10);
+            line[k]  = v0 + e.t * (v1 - v0);
+        }
+    }
+    [[nodiscard]] const std::vector<float>& continentalness() const { return mAxes[0]; }
+
+private:
+    [[nodiscard]] float value(std::size_t output, std::size_t c, std::size_t e, std::size_t w) const {
+        return mValues[output][(c * mAxes[1].size() + e) * mAxes[2].size() + w];
+    }
+
+    std::array<std::vector<float>, 3> mAxes;   // continentalness, erosion, weirdness nodes
+    std::array<std::vector<float>, 3> mValues; // per output, indexed [c][e][w]
+};
+
+std::optional<VanillaGrid> VanillaGrid::load(const std::string& path, std::string* error) {
+    std::ifstream file(path);
+    if (!file) {
+        *error = "can't read " + path;
+        return std::nullopt;
+    }
+    constexpr const char* columns[] = {"continentalness", "erosion", "weirdness", "factor", "jaggedness", "offset"};
+    std::string           header;
+    std::getline(file, header);
+    std::array<std::size_t, 6> column{};
+    std::vector<std::string>   names;
+    {
+        std::stringstream stream(header);
+        for (std::string name; std::getline(stream, name, ',');) {
+            name.erase(std::remove_if(name.begin(), name.end(), [](char c) { return std::isspace(c); }), name.end());
+            names.push_back(name);
+        }
+    }
+    for (std::size_t i = 0; i < 6; i++) {
+        auto it = std::find(names.begin(), names.end(), columns[i]);
+        if (it == names.end()) {
+            *error = path + " has no '" + columns[i] + "' column";
+            return std::nullopt;
+        }
+        column[i] = static_cast<std::size_t>(it - names.begin());
+    }
+
+    std::vector<std::array<float, 6>> rows;
+    std::vector<float>                fields;
+    std::size_t                       number = 1;
+    for (std::string text; std::getline(file, text);) {
+        number++;
+        if (text.find_first_not_of(" \t\r") == std::string::npos) continue;
+        fields.clear();
+        for (const char* p = text.c_str();;) {
+            char* end;
+            fields.push_back(std::strtof(p, &end));
+            if (end == p) {
+                *error = path + ":" + std::to_string(number) + ": expected a number";
+                return std::nullopt;
+            }
+            p = end + std::strspn(end, " \t\r");
+            if (*p != ',') break;
+            p++;
+        }
+        if (fields.size() != names.size()) {
+            *error = path + ":" + std::to_string(number) + ": expected " + std::to_string(names.size()) + " fields";
+            return std::nullopt;
+        }
+        std::array<float, 6> row;
+        for (std::size_t i = 0; i < 6; i++) row[i] = fields[column[i]];
+        rows.push_back(row);
+    }
+
+    VanillaGrid grid;
+    for (std::size_t a = 0; a < 3; a++) {
+        auto& axis = grid.mAxes[a];
+        for (auto& row : rows) axis.push_back(row[a]);
+        std::sort(axis.begin(), axis.end());
+        axis.erase(std::unique(axis.begin(), axis.end()), axis.end());
+    }
+    auto size = grid.mAxes[0].size() * grid.mAxes[1].size() * grid.mAxes[2].size();
+    if (rows.empty() || rows.size() != size) {
+        *error = path + " doesn't hold exactly one sample per grid point";
+        return std::nullopt;
+    }
+    std::vector<bool> seen(size, false);
+    for (auto& values : grid.mValues) values.resize(size);
+    for (auto& row : rows) {
+        std::size_t index = 0;
+        for (std::size_t a = 0; a < 3; a++) {
+            auto& axis = grid.mAxes[a];
+            index      = index * axis.size()
+                  + static_cast<std::size_t>(std::lower_bound(axis.begin(), axis.end(), row[a]) - axis.begin());
+        }
+        if (seen[index]) {
+            *error = path + " has more than one sample at a grid point";
+            return std::nullopt;
+        }
+        seen[index] = true;
+        for (std::size_t o = 0; o < 3; o++) grid.mValues[o][index] = row[3 + o];
+    }
+    return grid;
+}
+
+struct Stats {
+    double      min = std::numeric_limits<double>::infinity(), max = -std::numeric_limits<double>::infinity();
+    double      sum = 0, diffSum = 0, maxDiff = 0;
+    std::size_t count = 0, changed = 0, nan = 0;
+
+    void add(float value, float vanilla) {
+        if (std::isnan(value)) {
+            nan++;
+            return;
+        }
+        auto diff  = std::abs(static_cast<double>(value) - vanilla);
+        min        = std::min<double>(min, value);
+        max        = std::max<double>(max, value);
+        sum       += value;
+        diffSum   += diff;
+        maxDiff    = std::max(maxDiff, diff);
+        changed   += value != vanilla;
+        count++;
+    }
+    void merge(const Stats& other) {
+        min      = std::min(min, other.min);
+        max      = std::max(max, other.max);
+        sum     += other.sum;
+        diffSum += other.diffSum;
+        maxDiff  = std::max(maxDiff, other.maxDiff);
+        count   += other.count;
+        changed += other.changed;
+        nan     += other.nan;
+    }
+};
+
+// One weirdness slice of an output, kept for the images and the CSV.
+struct Slice {
+    std::vector<float> values, vanilla; // [erosion][continentalness]
+};
+
+struct Output {
+    expr::Program program;
+    Stats         stats;
+    Slice         slice;
+    expr::Profile profile;
+};
+
+bool parse_range(const char* text, Axis& axis) {
+    char* end;
+    axis.min = std::strtof(text, &end);
+    if (*end != ':') return false;
+    axis.max = std::strtof(end + 1, &end);
+    return *end == 0 && axis.min <= axis.max;
+}
+
+bool parse_grid(const char* text, Options& options) {
+    std::size_t c, e, w;
+    if (std::sscanf(text, "%zu,%zu,%zu", &c, &e, &w) != 3 || !c || !e || !w) return false;
+    options.continentalness.count = c;
+    options.erosion.count         = e;
+    options.weirdness.count       = w;
+    return true;
+}
+
+// The three formulas of a config.json, and the definitions they may call.
+struct Sources {
+    std::array<std::string, 3> formulas;
+    std::string                functions;
+};
+
+std::optional<Sources> read_sources(const std::string& path, std::string* error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        *error = "can't read " + path;
+        return std::nullopt;
+    }
+    std::string content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    auto        json = nlohmann::json::parse(content, nullptr, false, true);
+    if (json.is_discarded() || !json.is_object()) {
+        *error = path + " is not a JSON object";
+        return std::nullopt;
+    }
+    Sources res;
+    for (std::size_t i = 0; i < 3; i++) {
+        auto it         = json.find(output_names[i]);
+        res.formulas[i] = it != json.end() && it->is_string() ? it->get<std::string>() : "ori;";
+    }
+    if (auto it = json.find("functions"); it != json.end() && it->is_string()) res.functions = it->get<std::string>();
+    return res;
+}
+
+// Evaluates every sample; rows of constant erosion and weirdness are handed out to the threads in chunks.
+void render(const Options& options, const VanillaGrid& vanilla, std::array<Output, 3>& outputs) {
+    auto                 columns = options.continentalness.count;
+    auto                 rows    = options.erosion.count * options.weirdness.count;
+    std::vector<float>   continentalness(columns);
+    std::vector<Bracket> brackets(columns);
+    for (std::size_t i = 0; i < columns; i++) {
+        continentalness[i] = options.continentalness.at(i);
+        brackets[i]        = bracket(vanilla.continentalness(), continentalness[i]);
+    }
+    for (auto& output : outputs) {
+        output.slice.values.resize(columns * options.erosion.count);
+        output.slice.vanilla.resize(columns * options.erosion.count);
+    }
+
+    constexpr std::size_t    chunk = 16;
+    std::atomic<std::size_t> next{0};
+    std::mutex               merge;
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < options.threads; t++) {
+        workers.emplace_back([&] {
+            expr::EvalContext            context;
+            std::vector<float>           erosion(columns), weirdness(columns), ori(columns), out(columns), line;
+            std::array<Stats, 3>         stats;
+            std::array<expr::Profile, 3> profiles;
+            for (std::size_t begin; (begin = next.fetch_add(chunk)) < rows;) {
+                for (auto row = begin; row < std::min(begin + chunk, rows); row++) {
+                    auto w = row / options.erosion.count, e = row % options.erosion.count;
+                    std::fill(erosion.begin(), erosion.end(), options.erosion.at(e));
+                    std::fill(weirdness.begin(), weirdness.end(), options.weirdness.at(w));
+                    for (std::size_t o = 0; o < 3; o++) {
+                        vanilla.line(o, erosion[0], weirdness[0], line);
+                        for (std::size_t i = 0; i < columns && !line.empty(); i++) {
+                            auto [k, f] = brackets[i];
+                            auto k1     = std::min(k + 1, line.size() - 1);
+                            ori[i]      = line[k] + f * (line[k1] - line[k]);
+                        }
+                        auto& program = outputs[o].program;
+                        if (program.isIdentity()) {
+                            out = ori;
+                        } else {
+                            program.evalBatch(ori, continentalness, erosion, weirdness, out, context);
+                        }
+                        if (options.profile && row % options.profile == 0 && !program.isIdentity()) {
+                            for (std::size_t i = 0; i < columns; i++) {
+                                expr::Slots slots{ori[i], continentalness[i], erosion[i], weirdness[i]};
+                                (void)program.evalFirst(slots, ori[i], profiles[o], context);
+                            }
+                        }
+                        for (std::size_t i = 0; i < columns; i++) stats[o].add(out[i], ori[i]);
+                        if (w == options.slice) {
+                            auto& slice = outputs[o].slice;
+                            std::copy(out.begin(), out.end(), slice.values.begin() + e * columns);
+                            std::copy(ori.begin(), ori.end(), slice.vanilla.begin() + e * columns);
+                        }
+                    }
+                }
+            }
+            std::lock_guard lock(merge);
+            for (std::size_t o = 0; o < 3; o++) {
+                outputs[o].stats.merge(stats[o]);
+                outputs[o].profile.add(profiles[o]);
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+using Color = std::array<float, 3>;
+
+constexpr Color sequential[] = {{68, 1, 84}, {59, 82, 139}, {33, 145, 140}, {94, 201, 98}, {253, 231, 37}};
+constexpr Color diverging[]  = {{59, 76, 192}, {221, 221, 221}, {180, 4, 38}}; // white at the middle
+
+Color gradient(std::span<const Color> stops, float t) {
+    auto n = stops.size() - 1;
+    t      = std::clamp(t, 0.0f, 1.0f) * static_cast<float>(n);
+    auto i = std::min(static_cast<std::size_t>(t), n - 1);
+    auto f = t - static_cast<float>(i);
+    auto a = stops[i], b = stops[i + 1];
+    return {a[0] + f * (b[0] - a[0]), a[1] + f * (b[1] - a[1]), a[2] + f * (b[2] - a[2])};
+}
+
+// Binary PPM with continentalness to the right and erosion upwards; NaN is black.
+bool write_ppm(
+    const std::string&        path,
+    const std::vector<float>& values,
+    std::size_t               width,
+    std::size_t               height,
+    float                     lo,
+    float                     hi,
+    std::span<const Color>    palette
+) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    file << "P6\n" << width << ' ' << height << "\n255\n";
+    std::vector<unsigned char> row(width * 3);
+    for (auto y = height; y-- > 0;) {
+        for (std::size_t x = 0; x < width; x++) {
+            auto  v = values[y * width + x];
+            Color color{0, 0, 0};
+            if (!std::isnan(v)) {
+                auto t = hi > lo ? (v - lo) / (hi - lo) : 0.5f;
+                color  = gradient(palette, t);
+            }
+            for (std::size_t c = 0; c < 3; c++) row[x * 3 + c] = static_cast<unsigned char>(color[c] + 0.5f);
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+    return static_cast<bool>(file);
+}
+
+bool write_slice(const Options& options, const std::string& name, const Slice& slice) {
+    auto               width = options.continentalness.count, height = options.erosion.count;
+    auto               lo = std::numeric_limits<float>::infinity(), hi = -lo, span = 0.0f;
+    std::vector<float> diff(slice.values.size());
+    for (std::size_t i = 0; i < diff.size(); i++) {
+        diff[i] = slice.values[i] - slice.vanilla[i];
+        if (std::isnan(slice.values[i])) continue;
+        lo   = std::min(lo, slice.values[i]);
+        hi   = std::max(hi, slice.values[i]);
+        span = std::max(span, std::abs(diff[i]));
+    }
+    auto prefix = options.out + "-" + name;
+    if (!write_ppm(prefix + ".ppm", slice.values, width, height, lo, hi, sequential)
+        || !write_ppm(prefix + "-diff.ppm", diff, width, height, -span, span, diverging)) {
+        return false;
+    }
+    auto file = std::fopen((prefix + ".csv").c_str(), "w");
+    if (!file) return false;
+    std::fprintf(file, "continentalness,erosion,vanilla,value,diff\n");
+    for (std::size_t y = 0; y < height; y++) {
+        for (std::size_t x = 0; x < width; x++) {
+            auto i = y * width + x;
+            std::fprintf(
+                file,
+                "%.9g,%.9g,%.9g,%.9g,%.9g\n",
+                options.continentalness.at(x),
+                options.erosion.at(y),
+                slice.vanilla[i],
+                slice.values[i],
+                diff[i]
+            );
+        }
+    }
+    return std::fclose(file) == 0;
+}
+
+bool write_profile(const Options& options, const std::array<Output, 3>& outputs) {
+    auto file = std::fopen((options.out + "-profile.txt").c_str(), "w");
+    if (!file) return false;
+    for (std::size_t o = 0; o < 3; o++) {
+        if (outputs[o].program.isIdentity()) continue;
+        std::fprintf(file, "%s: %s\n", output_names[o], outputs[o].program.annotate(outputs[o].profile).c_str());
+    }
+    return std::fclose(file) == 0;
+}
+
+// JSON has no NaN or infinity.
+std::string number(double value) {
+    if (!std::isfinite(value)) return "null";
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+    return buffer;
+}
+
+void print_json(const Options& options, const std::array<Output, 3>& outputs, double seconds) {
+    auto samples = options.continentalness.count * options.erosion.count * options.weirdness.count;
+    std::printf("{\n");
+    std::printf(
+        "  \"grid\": [%zu, %zu, %zu],\n",
+        options.continentalness.count,
+        options.erosion.count,
+        options.weirdness.count
+    );
+    std::printf("  \"slice_weirdness\": %s,\n", number(options.weirdness.at(options.slice)).c_str());
+    std::printf("  \"threads\": %u,\n", options.threads);
+    std::printf("  \"seconds\": %.3f,\n", seconds);
+    std::printf("  \"ns_per_sample\": %.3f,\n", seconds * 1e9 / static_cast<double>(3 * samples));
+    std::printf("  \"outputs\": [\n");
+    for (std::size_t o = 0; o < 3; o++) {
+        auto& s     = outputs[o].stats;
+        auto  count = static_cast<double>(std::max<std::size_t>(s.count, 1));
+        std::printf(
+            "    {\"name\": \"%s\", \"identity\": %s, \"min\": %s, \"max\": %s, \"mean\": %s, \"mean_abs_diff\": %s, "
+            "\"max_abs_diff\": %s, \"changed\": %s, \"nan\": %zu}%s\n",
+            output_names[o],
+            outputs[o].program.isIdentity() ? "true" : "false",
+            number(s.min).c_str(),
+            number(s.max).c_str(),
+            number(s.sum / count).c_str(),
+            number(s.diffSum / count).c_str(),
+            number(s.maxDiff).c_str(),
+            number(static_cast<double>(s.changed) / count).c_str(),
+            s.nan,
+            o + 1 < 3 ? "," : ""
+        );
+    }
+    std::printf("  ]\n}\n");
+}
+
+void usage(const char* name) {
+    std::fprintf(
+        stderr,
+        "usage: %s --config FILE [--vanilla FILE] [--out PREFIX] [--grid C,E,W] [--slice K]\n"
+        "          [--continentalness MIN:MAX] [--erosion MIN:MAX] [--weirdness MIN:MAX]\n"
+        "          [--backend tree|bytecode|jit] [--threads N] [--profile ROWS]\n",
+        name
+    );
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        auto arg   = argv[i];
+        auto value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok    = value != nullptr;
+        if (ok && std::strcmp(arg, "--config") == 0) {
+            options.config = value;
+        } else if (ok && std::strcmp(arg, "--vanilla") == 0) {
+            options.vanilla = value;
+        } else if (ok && std::strcmp(arg, "--out") == 0) {
+            options.out = value;
+        } else if (ok && std::strcmp(arg, "--grid") == 0) {
+            ok = parse_grid(value, options);
+        } else if (ok && std::strcmp(arg, "--slice") == 0) {
+            options.slice = static_cast<std::size_t>(std::strtoull(value, nullptr, 10));
+        } else if (ok && std::strcmp(arg, "--continentalness") == 0) {
+            ok = parse_range(value, options.continentalness);
+        } else if (ok && std::strcmp(arg, "--erosion") == 0) {
+            ok = parse_range(value, options.erosion);
+        } else if (ok && std::strcmp(arg, "--weirdness") == 0) {
+            ok = parse_range(value, options.weirdness);
+        } else if (ok && std::strcmp(arg, "--backend") == 0) {
+            options.backend = value;
+        } else if (ok && std::strcmp(arg, "--threads") == 0) {
+            options.threads = static_cast<unsigned>(std::max(1, std::atoi(value)));
+        } else if (ok && std::strcmp(arg, "--profile") == 0) {
+            options.profile = static_cast<std::size_t>(std::strtoull(value, nullptr, 10));
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (options.config.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (options.slice >= options.weirdness.count) options.slice = options.weirdness.count / 2;
+
+    auto backend = expr::Backend::Bytecode;
+    if (options.backend == "tree") {
+        backend = expr::Backend::Tree;
+    } else if (options.backend == "jit") {
+        backend = expr::Backend::Jit;
+    } else if (options.backend != "bytecode") {
+        std::fprintf(stderr, "unknown backend \"%s\"\n", options.backend.c_str());
+        return 1;
+    }
+
+    std::string error;
+    auto        sources = read_sources(options.config, &error);
+    if (!sources) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    VanillaGrid vanilla;
+    if (!options.vanilla.empty()) {
+        auto grid = VanillaGrid::load(options.vanilla, &error);
+        if (!grid) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        vanilla = std::move(*grid);
+    }
+
+    // The plugin's `info` logs its argument; here it only passes it through so such configs still render.
+    expr::FunctionTable functions{
+        {"info", [](const std::vector<std::vector<float>>& args) {
+             return args.empty() ? std::vector<float>{} : args[0];
+         }}
+    };
+    auto definitions = expr::define(sources->functions, functions, &error);
+    if (!definitions) {
+        std::fprintf(stderr, "functions \"%s\": %s\n", sources->functions.c_str(), error.c_str());
+        return 1;
+    }
+    std::array<Output, 3> outputs;
+    for (std::size_t o = 0; o < 3; o++) {
+        auto& formula = sources->formulas[o];
+        auto  program = expr::compile(formula, functions, &error, *definitions);
+        if (!program) {
+            std::fprintf(stderr, "%s formula \"%s\": %s\n", output_names[o], formula.c_str(), error.c_str());
+            return 1;
+        }
+        program->setBackend(backend);
+        outputs[o].program = std::move(*program);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    render(options, vanilla, outputs);
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    for (std::size_t o = 0; o < 3; o++) {
+        if (!write_slice(options, output_names[o], outputs[o].slice)) {
+            std::fprintf(stderr, "can't write %s-%s.ppm, -diff.ppm or .csv\n", options.out.c_str(), output_names[o]);
+            return 1;
+        }
+    }
+    if (options.profile && !write_profile(options, outputs)) {
+        std::fprintf(stderr, "can't write %s-profile.txt\n", options.out.c_str());
+        return 1;
+    }
+    print_json(options, outputs, seconds);
+    return 0;
+}
@@ -5,12 +5,132 @@ add_repositories("liteldev-repo https://github.com/LiteLDev/xmake-repo.git")
 -- add_requires("levilamina x.x.x") for a specific version
 -- add_requires("levilamina develop") to use develop version
 -- please note that you should add bdslibrary yourself if using dev version
-add_requires("levilamina")
+if is_plat("windows") then
+    add_requires("levilamina")
+end
+add_requires("nlohmann_json") -- For the tools; LeviLamina brings its own for the plugin.
+
+option("formulas")
+    set_showmenu(true)
+    set_description("config.json whose formulas are compiled into the plugin ahead of time")
+option_end()
+
+-- Compiles the formulas of a config.json added to the target into C++ with climate_codegen. The target
+-- must also depend on climate_codegen.
+rule("climate_formulas")
+    set_extensions(".json")
+    on_buildcmd_file(function (target, batchcmds, sourcefile, opt)
+        local codegen    = target:dep("climate_codegen")
+        local generated  = path.join(target:autogendir(), "rules", "climate_formulas", path.basename(sourcefile) .. ".cpp")
+        local objectfile = target:objectfile(generated)
+        table.insert(target:objectfiles(), objectfile)
+
+        batchcmds:show_progress(opt.progress, "${color.build.object}generating.formulas %s", sourcefile)
+        batchcmds:mkdir(path.directory(generated))
+        batchcmds:vrunv(codegen:targetfile(), {sourcefile, generated})
+        -- Contracting a * b + c into a fused multiply-add would round differently from the interpreter.
+        -- MSVC only contracts with /fp:contract.
+        local cxflags = target:has_tool("cxx", "cl") and {} or {"-ffp-contract=off"}
+        batchcmds:compile(generated, objectfile, {configs = {cxflags = cxflags}})
+
+        batchcmds:add_depfiles(sourcefile, codegen:targetfile())
+        batchcmds:set_depmtime(os.mtime(objectfile))
+        batchcmds:set_depcache(target:dependfile(objectfile))
+    end)
+rule_end()
 
 if not has_config("vs_runtime") then
     set_runtimes("MD")
 end
 
+-- The expression engine has no LeviLamina dependency, so it also builds on Linux for expr_bench.
+target("expr")
+    if is_plat("windows") then
+        add_cxflags("/EHa", "/utf-8", "/W4")
+        add_defines("NOMINMAX", "UNICODE")
+        set_exceptions("none") -- To avoid conflicts with /EHa.
+    end
+    add_files("src/expr/*.cpp")
+    add_includedirs("src", {public = true})
+    set_kind("static")
+    set_languages("c++20")
+
+target("expr_bench")
+    set_default(not is_plat("windows"))
+    add_deps("expr")
+    add_files("src/bench/*.cpp")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+    set_kind("binary")
+    set_languages("c++20")
+
+target("climate_codegen")
+    if is_plat("windows") then
+        add_cxflags("/EHa", "/utf-8", "/W4")
+        add_defines("NOMINMAX", "UNICODE")
+        set_exceptions("none") -- To avoid conflicts with /EHa.
+    end
+    add_deps("expr")
+    add_files("src/codegen/*.cpp")
+    add_packages("nlohmann_json")
+    set_kind("binary")
+    set_languages("c++20")
+
+-- Evaluates programs on every backend from many threads and compares with one thread: `xmake test`.
+target("expr_threads_test")
+    set_default(false)
+    add_deps("expr")
+    add_files("src/expr/test/ThreadsTest.cpp")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+    add_tests("default")
+    set_kind("binary")
+    set_languages("c++20")
+
+-- Compares native code with both interpreters on random inputs: `xmake test`.
+target("jit_test")
+    set_default(false)
+    add_deps("expr")
+    add_files("src/expr/test/JitTest.cpp")
+    add_tests("default")
+    set_kind("binary")
+    set_languages("c++20")
+
+-- Checks the errors reported for malformed formulas and definitions: `xmake test`.
+target("expr_parser_test")
+    set_default(false)
+    add_deps("expr")
+    add_files("src/expr/test/ParserTest.cpp")
+    add_tests("default")
+    set_kind("binary")
+    set_languages("c++20")
+
+-- Compares the code generated from src/codegen/test/config.json with the interpreter: `xmake test`.
+target("codegen_test")
+    set_default(false)
+    add_rules("climate_formulas")
+    add_deps("expr", "climate_codegen")
+    add_files("src/codegen/test/*.cpp", "src/codegen/test/config.json")
+    add_tests("default")
+    set_kind("binary")
+    set_languages("c++20")
+
+-- Offline renderer for tuning formulas on the machines they are written on, away from the server.
+if not is_plat("windows") then
+target("climate_render")
+    add_deps("expr")
+    add_files("src/render/*.cpp")
+    add_packages("nlohmann_json")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+    set_kind("binary")
+    set_languages("c++20")
+end
+
+if is_plat("windows") then
 target("OverworldClimateModify") -- Change this to your plugin name.
     add_cxflags(
         "/EHa",
@@ -24,7 +144,16 @@ target("OverworldClimateModify") -- Change this to your plugin name.
         "/w45204"
     )
     add_defines("NOMINMAX", "UNICODE")
-    add_files("src/**.cpp")
+    add_deps("expr")
+    -- Formulas compiled ahead of time, used while config.json holds the same ones.
+    if has_config("formulas") then
+        add_rules("climate_formulas")
+        add_deps("climate_codegen")
+        add_files(get_config("formulas"))
+        add_files("src/plugin/**.cpp|NoGeneratedFormulas.cpp")
+    else
+        add_files("src/plugin/**.cpp")
+    end
     add_includedirs("src")
     add_packages("levilamina")
     add_shflags("/DELAYLOAD:bedrock_server.dll") -- To use symbols provided by SymbolProvider.
@@ -50,3 +179,4 @@ target("OverworldClimateModify") -- Change this to your plugin name.
         
         plugin_packer.pack_plugin(target,plugin_define)
     end)
+end